@@ -0,0 +1,269 @@
+/*
+ * Dilithium Key Generation - C++ Expression Templates
+ * Header-only layer over poly / polyveck / polyvecl
+ *
+ * Writing
+ *
+ *     dilithium::ref(t) = dilithium::mat(A) * dilithium::ref(s1)
+ *                         + dilithium::ref(s2);
+ *
+ * builds a small expression tree and evaluates it in one loop over the
+ * destination at assignment time - no temporary polys and no extra passes.
+ * Every node reduces exactly like its C kernel (poly_add, poly_sub,
+ * poly_pointwise_multiply, poly_shiftl, matrix_vector_multiply), and all
+ * results are canonical in [0, Q), so the output is bit-identical
+ * (Dilithium_expr_check.cpp compares the two).
+ *
+ * Aliasing: coefficient-wise nodes read only index (row, i), so the
+ * destination may appear on the right-hand side. A matrix product reads
+ * whole rows of its vector operand, so that operand must not alias the
+ * destination.
+ *
+ * The C header defines single-letter parameter macros (Q, N, K, L, D);
+ * include standard headers before this one.
+ */
+
+#ifndef DILITHIUM_EXPR_HPP
+#define DILITHIUM_EXPR_HPP
+
+#include <cstdint>
+#include <type_traits>
+
+#include "Dilithium_key_gen.h"
+
+namespace dilithium {
+
+// ============================================================================
+// EXPRESSION BASE
+// ============================================================================
+// Every expression is a vector of `rows` polys (a plain poly is one row)
+// and exposes at(row, i). `vec_type` is the C type it evaluates to, which
+// keeps polyveck and polyvecl operands from being mixed even though K == L.
+
+template <class E>
+struct Expr {
+    const E &self() const { return static_cast<const E &>(*this); }
+};
+
+template <class T> struct vec_traits;
+
+template <> struct vec_traits<poly> {
+    static constexpr int rows = 1;
+    static poly &row(poly &v, int) { return v; }
+    static const poly &row(const poly &v, int) { return v; }
+};
+
+template <> struct vec_traits<polyveck> {
+    static constexpr int rows = K;
+    static poly &row(polyveck &v, int r) { return v.vec[r]; }
+    static const poly &row(const polyveck &v, int r) { return v.vec[r]; }
+};
+
+template <> struct vec_traits<polyvecl> {
+    static constexpr int rows = L;
+    static poly &row(polyvecl &v, int r) { return v.vec[r]; }
+    static const poly &row(const polyvecl &v, int r) { return v.vec[r]; }
+};
+
+// ============================================================================
+// LEAVES
+// ============================================================================
+
+/* Read-only operand */
+template <class T>
+struct ConstRef : Expr<ConstRef<T>> {
+    using vec_type = T;
+    const T &v;
+
+    explicit ConstRef(const T &v_) : v(v_) {}
+    int32_t at(int r, int i) const {
+        return vec_traits<T>::row(v, r).coeffs[i];
+    }
+};
+
+/* Assignable operand: ref(x) = expr evaluates the whole tree into x */
+template <class T>
+struct Ref : Expr<Ref<T>> {
+    using vec_type = T;
+    T &v;
+
+    explicit Ref(T &v_) : v(v_) {}
+    Ref(const Ref &) = default;
+    int32_t at(int r, int i) const {
+        return vec_traits<T>::row(v, r).coeffs[i];
+    }
+
+    template <class E>
+    Ref &operator=(const Expr<E> &expr) {
+        static_assert(std::is_same<typename E::vec_type, T>::value,
+                      "expression type does not match destination");
+        const E &e = expr.self();
+        for (int r = 0; r < vec_traits<T>::rows; r++) {
+            poly &dst = vec_traits<T>::row(v, r);
+            for (int i = 0; i < N; i++) {
+                dst.coeffs[i] = e.at(r, i);
+            }
+        }
+        return *this;
+    }
+
+    Ref &operator=(const Ref &other) {
+        return *this = static_cast<const Expr<Ref> &>(other);
+    }
+};
+
+template <class T> Ref<T> ref(T &v) { return Ref<T>(v); }
+template <class T> ConstRef<T> ref(const T &v) { return ConstRef<T>(v); }
+
+/* K x L matrix operand, as produced by expand_matrix_a */
+struct Matrix {
+    const poly (&A)[K][L];
+    explicit Matrix(const poly (&A_)[K][L]) : A(A_) {}
+};
+
+inline Matrix mat(const poly (&A)[K][L]) { return Matrix(A); }
+
+// ============================================================================
+// NODES
+// ============================================================================
+
+template <class Lhs, class Rhs>
+struct BinaryCheck {
+    static_assert(std::is_same<typename Lhs::vec_type,
+                               typename Rhs::vec_type>::value,
+                  "operands have different vector types");
+    using vec_type = typename Lhs::vec_type;
+};
+
+/* a + b (mod Q), as poly_add */
+template <class Lhs, class Rhs>
+struct AddExpr : Expr<AddExpr<Lhs, Rhs>> {
+    using vec_type = typename BinaryCheck<Lhs, Rhs>::vec_type;
+    Lhs a;
+    Rhs b;
+
+    AddExpr(const Lhs &a_, const Rhs &b_) : a(a_), b(b_) {}
+    int32_t at(int r, int i) const {
+        return reduce_mod_q((int64_t)a.at(r, i) + b.at(r, i));
+    }
+};
+
+/* a - b (mod Q), as poly_sub */
+template <class Lhs, class Rhs>
+struct SubExpr : Expr<SubExpr<Lhs, Rhs>> {
+    using vec_type = typename BinaryCheck<Lhs, Rhs>::vec_type;
+    Lhs a;
+    Rhs b;
+
+    SubExpr(const Lhs &a_, const Rhs &b_) : a(a_), b(b_) {}
+    int32_t at(int r, int i) const {
+        return reduce_mod_q((int64_t)a.at(r, i) - b.at(r, i));
+    }
+};
+
+/* a[i] * b[i] (mod Q), as poly_pointwise_multiply */
+template <class Lhs, class Rhs>
+struct MulExpr : Expr<MulExpr<Lhs, Rhs>> {
+    using vec_type = typename BinaryCheck<Lhs, Rhs>::vec_type;
+    Lhs a;
+    Rhs b;
+
+    MulExpr(const Lhs &a_, const Rhs &b_) : a(a_), b(b_) {}
+    int32_t at(int r, int i) const {
+        return reduce_mod_q((int64_t)a.at(r, i) * b.at(r, i));
+    }
+};
+
+/* a * 2^k (mod Q), as poly_shiftl */
+template <class Arg>
+struct ShiftExpr : Expr<ShiftExpr<Arg>> {
+    using vec_type = typename Arg::vec_type;
+    Arg a;
+    unsigned k;
+
+    ShiftExpr(const Arg &a_, unsigned k_) : a(a_), k(k_) {}
+    int32_t at(int r, int i) const {
+        return reduce_mod_q((int64_t)a.at(r, i) * ((int64_t)1 << k));
+    }
+};
+
+/* reduce_mod_q of every coefficient (maps centered values into [0, Q)) */
+template <class Arg>
+struct ReduceExpr : Expr<ReduceExpr<Arg>> {
+    using vec_type = typename Arg::vec_type;
+    Arg a;
+
+    explicit ReduceExpr(const Arg &a_) : a(a_) {}
+    int32_t at(int r, int i) const { return reduce_mod_q(a.at(r, i)); }
+};
+
+/*
+ * A * s for an L-vector expression s. Coefficient i of row r is the
+ * negacyclic convolution sum over j of A[r][j] * s[j], accumulated with
+ * the same per-product reduction as poly_multiply/matrix_vector_multiply.
+ * Operand coefficients are fetched through at(), so s may itself be an
+ * expression (evaluated on the fly, L*N times per output coefficient).
+ */
+template <class Vec>
+struct MatVecExpr : Expr<MatVecExpr<Vec>> {
+    static_assert(std::is_same<typename Vec::vec_type, polyvecl>::value,
+                  "matrix operand must be an L-vector");
+    using vec_type = polyveck;
+    Matrix m;
+    Vec s;
+
+    MatVecExpr(const Matrix &m_, const Vec &s_) : m(m_), s(s_) {}
+    int32_t at(int r, int i) const {
+        int32_t acc = 0;
+        for (int j = 0; j < L; j++) {
+            const int32_t *a = m.A[r][j].coeffs;
+            for (int k = 0; k < N; k++) {
+                // a[k] * x^k * s[i-k] x^(i-k), wrapping with x^N = -1
+                int idx = i - k;
+                int64_t product = (int64_t)a[k] * s.at(j, idx & (N - 1));
+                if (idx < 0) product = -product;
+                acc = reduce_mod_q(acc + product);
+            }
+        }
+        return acc;
+    }
+};
+
+// ============================================================================
+// OPERATORS
+// ============================================================================
+
+template <class Lhs, class Rhs>
+AddExpr<Lhs, Rhs> operator+(const Expr<Lhs> &a, const Expr<Rhs> &b) {
+    return AddExpr<Lhs, Rhs>(a.self(), b.self());
+}
+
+template <class Lhs, class Rhs>
+SubExpr<Lhs, Rhs> operator-(const Expr<Lhs> &a, const Expr<Rhs> &b) {
+    return SubExpr<Lhs, Rhs>(a.self(), b.self());
+}
+
+/* Coefficient-wise product (use mat(A) * s for the matrix product) */
+template <class Lhs, class Rhs>
+MulExpr<Lhs, Rhs> operator*(const Expr<Lhs> &a, const Expr<Rhs> &b) {
+    return MulExpr<Lhs, Rhs>(a.self(), b.self());
+}
+
+template <class Vec>
+MatVecExpr<Vec> operator*(const Matrix &m, const Expr<Vec> &s) {
+    return MatVecExpr<Vec>(m, s.self());
+}
+
+template <class Arg>
+ShiftExpr<Arg> shiftl(const Expr<Arg> &a, unsigned k) {
+    return ShiftExpr<Arg>(a.self(), k);
+}
+
+template <class Arg>
+ReduceExpr<Arg> reduce(const Expr<Arg> &a) {
+    return ReduceExpr<Arg>(a.self());
+}
+
+} // namespace dilithium
+
+#endif
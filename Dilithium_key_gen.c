@@ -2,66 +2,376 @@
  * Dilithium Key Generation - Educational Implementation
  * This is a simplified version for learning purposes
  * For production, use the official NIST PQC Dilithium library
+ *
+ * Build: gcc -O2 -pthread -DSHAKE_NO_MAIN Dilithium_key_gen.c SHAKE.c
  */
 
+#define _GNU_SOURCE        // pthread_setaffinity_np
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <sys/random.h>
+#include <sys/wait.h>
+#include "Dilithium_key_gen.h"
+#include "SHAKE.h"
 
 // ============================================================================
-// PARAMETERS (Dilithium2 variant)
+// SCRATCH ARENA
 // ============================================================================
-#define Q 8380417          // Prime modulus
-#define N 256              // Polynomial degree
-#define K 4                // Matrix height
-#define L 4                // Matrix width
-#define ETA 2              // Secret coefficient bound
-#define D 13               // Dropped bits from t
-#define SEEDBYTES 32       // Seed size
-#define POLYBYTES 32       // Bytes per polynomial coefficient range
+/*
+ * Bump allocator for arithmetic temporaries. Each thread owns one fixed
+ * buffer; functions take a mark on entry and roll back to it on exit, so
+ * scratch is reused call after call and stays hot in L1/L2. The peak
+ * counter tells us how large the per-thread buffer actually has to be.
+ */
+#define SCRATCH_BYTES (64 * 1024)  // Per-thread scratch size
 
-// ============================================================================
-// POLYNOMIAL STRUCTURE
-// ============================================================================
-typedef struct {
-    int32_t coeffs[N];     // 256 coefficients, each mod Q
-} poly;
+/* Attach an arena to a caller-provided buffer */
+void arena_init(poly_arena *a, void *buf, size_t size) {
+    uintptr_t start = (uintptr_t)buf;
+    uintptr_t aligned = (start + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1);
 
-typedef struct {
-    poly vec[K];           // Vector of K polynomials
-} polyveck;
+    a->base = (uint8_t *)aligned;
+    a->size = (aligned - start < size) ? size - (aligned - start) : 0;
+    a->used = 0;
+    a->peak = 0;
+}
 
-typedef struct {
-    poly vec[L];           // Vector of L polynomials
-} polyvecl;
+/* Bump-allocate an ARENA_ALIGN aligned block */
+void *arena_alloc(poly_arena *a, size_t bytes) {
+    size_t off = (a->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (off > a->size || bytes > a->size - off) {
+        fprintf(stderr, "Scratch arena exhausted (%zu + %zu > %zu bytes)\n",
+                off, bytes, a->size);
+        abort();
+    }
+
+    a->used = off + bytes;
+    if (a->used > a->peak) a->peak = a->used;
+    return a->base + off;
+}
+
+/* Remember the current position... */
+arena_mark arena_save(const poly_arena *a) {
+    return a->used;
+}
+
+/* ...and release everything allocated since */
+void arena_restore(poly_arena *a, arena_mark m) {
+    a->used = m;
+}
+
+/* Typed helpers for the common scratch shapes */
+poly *arena_poly(poly_arena *a) {
+    return arena_alloc(a, sizeof(poly));
+}
+
+polyveck *arena_polyveck(poly_arena *a) {
+    return arena_alloc(a, sizeof(polyveck));
+}
+
+polyvecl *arena_polyvecl(poly_arena *a) {
+    return arena_alloc(a, sizeof(polyvecl));
+}
+
+/* This thread's scratch arena, set up on first use */
+poly_arena *scratch_arena(void) {
+    static _Thread_local _Alignas(ARENA_ALIGN) uint8_t buf[SCRATCH_BYTES];
+    static _Thread_local poly_arena arena;
+
+    if (arena.base == NULL) {
+        arena_init(&arena, buf, sizeof(buf));
+    }
+    return &arena;
+}
 
 // ============================================================================
-// KEY STRUCTURES
+// LATENCY MODE (FORK-JOIN)
 // ============================================================================
-typedef struct {
-    uint8_t seed[SEEDBYTES];  // Seed for generating A
-    polyveck t1;               // High bits of t
-} public_key;
+/*
+ * Optional intra-operation parallelism. A small group of pinned workers
+ * spins waiting for a job; the caller publishes `count` independent tasks,
+ * everyone (caller included) claims indices with an atomic counter, and
+ * the caller returns once every worker has checked back in. Matrix rows
+ * are ~1 ms of work each here, so a spin handoff is far below the task
+ * cost, whereas a mutex/condvar wakeup would not be. A fork_join issued
+ * from inside a task (e.g. a batch task calling matrix_vector_multiply)
+ * runs inline on that thread. The pool carries one job at a time: a caller
+ * that finds it claimed by another thread runs its own job inline rather
+ * than queueing behind it.
+ */
+#define MAX_WORKERS 8
+#define SPIN_LIMIT 4096           // Busy-wait rounds before yielding the CPU
+
+typedef struct fork_join_pool fork_join_pool;
 
 typedef struct {
-    uint8_t seed[SEEDBYTES];  // Seed for generating A
-    polyvecl s1;               // Secret vector 1
-    polyveck s2;               // Secret vector 2
-    polyveck t0;               // Low bits of t
-} secret_key;
+    fork_join_pool *pool;
+    unsigned seen;                // Generation current when the worker started
+} fj_worker_arg;
+
+struct fork_join_pool {
+    pthread_t threads[MAX_WORKERS];
+    fj_worker_arg args[MAX_WORKERS];
+    int nworkers;                 // Helper threads (caller is one more)
+    fj_task fn;                   // Current job
+    void *arg;
+    int count;
+    atomic_uint generation;       // Bumped to publish a job
+    atomic_int next;              // Next task index to claim
+    atomic_int finished;          // Workers done with the current job
+    atomic_int stop;
+    atomic_flag busy;             // Held by the caller that owns the job slot
+};
+
+static fork_join_pool latency_pool = { .busy = ATOMIC_FLAG_INIT };
+static atomic_int latency_threads = 1;   // 1 = sequential (latency mode off)
+static _Thread_local int in_fork_join = 0;
+
+/* Spin briefly, then back off so an oversubscribed machine still progresses */
+static inline void spin_wait(unsigned *spins) {
+    if (++*spins < SPIN_LIMIT) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        sched_yield();
+    }
+}
+
+/* Claim and run tasks until the job is exhausted */
+static void fj_run_tasks(fork_join_pool *pool) {
+    int i;
+    while ((i = atomic_fetch_add(&pool->next, 1)) < pool->count) {
+        pool->fn(pool->arg, i);
+    }
+}
+
+static void *fj_worker(void *arg) {
+    fj_worker_arg *wa = arg;
+    fork_join_pool *pool = wa->pool;
+    unsigned seen = wa->seen;     // generation survives disable/enable cycles
+
+    in_fork_join = 1;
+    for (;;) {
+        unsigned spins = 0;
+        unsigned gen;
+        while ((gen = atomic_load_explicit(&pool->generation,
+                                           memory_order_acquire)) == seen) {
+            spin_wait(&spins);
+        }
+        seen = gen;
+        if (atomic_load(&pool->stop)) break;
+
+        fj_run_tasks(pool);
+        atomic_fetch_add_explicit(&pool->finished, 1, memory_order_release);
+    }
+    return NULL;
+}
+
+/* Run fn(arg, 0..count-1) across the pool, or inline when latency mode is off */
+void fork_join(fj_task fn, void *arg, int count) {
+    fork_join_pool *pool = &latency_pool;
+
+    if (atomic_load_explicit(&latency_threads, memory_order_relaxed) <= 1
+        || in_fork_join
+        || atomic_flag_test_and_set_explicit(&pool->busy, memory_order_acquire)) {
+        for (int i = 0; i < count; i++) fn(arg, i);
+        return;
+    }
+
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->count = count;
+    atomic_store(&pool->next, 0);
+    atomic_store(&pool->finished, 0);
+    atomic_fetch_add_explicit(&pool->generation, 1, memory_order_release);
+
+    in_fork_join = 1;
+    fj_run_tasks(pool);
+    in_fork_join = 0;
+
+    unsigned spins = 0;
+    while (atomic_load_explicit(&pool->finished, memory_order_acquire)
+           != pool->nworkers) {
+        spin_wait(&spins);
+    }
+    atomic_flag_clear_explicit(&pool->busy, memory_order_release);
+}
+
+/* Make every later fork_join on the calling thread run inline (for
+ * background threads, which must not share the workers with the caller) */
+void fork_join_run_inline(void) {
+    in_fork_join = 1;
+}
+
+/* Switch latency mode on with `threads` participants (caller included) */
+void latency_mode_enable(int threads) {
+    fork_join_pool *pool = &latency_pool;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (atomic_load(&latency_threads) > 1) return;  // Already running
+    if (threads > MAX_WORKERS + 1) threads = MAX_WORKERS + 1;
+    if (threads <= 1) return;
+
+    atomic_store(&pool->stop, 0);
+    pool->nworkers = 0;
+    for (int w = 0; w < threads - 1; w++) {
+        pool->args[w].pool = pool;
+        pool->args[w].seen = atomic_load(&pool->generation);
+        if (pthread_create(&pool->threads[w], NULL, fj_worker,
+                           &pool->args[w]) != 0) {
+            fprintf(stderr, "Could not start latency worker %d\n", w);
+            break;
+        }
+        // Pin worker w to core w+1; callers stay unpinned, so core 0 is
+        // only kept free of workers, not reserved for them
+        if (ncpu > 1) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET((w + 1) % ncpu, &set);
+            pthread_setaffinity_np(pool->threads[w], sizeof(set), &set);
+        }
+        pool->nworkers++;
+    }
+    atomic_store(&latency_threads, pool->nworkers + 1);
+}
+
+/* Stop and join the workers; operations run sequentially again */
+void latency_mode_disable(void) {
+    fork_join_pool *pool = &latency_pool;
+
+    if (atomic_load(&latency_threads) <= 1) return;
+
+    // New callers go inline; wait out a job still using the workers
+    atomic_store(&latency_threads, 1);
+    unsigned spins = 0;
+    while (atomic_flag_test_and_set_explicit(&pool->busy, memory_order_acquire)) {
+        spin_wait(&spins);
+    }
+    atomic_store(&pool->stop, 1);
+    atomic_fetch_add_explicit(&pool->generation, 1, memory_order_release);
+    for (int w = 0; w < pool->nworkers; w++) {
+        pthread_join(pool->threads[w], NULL);
+    }
+    pool->nworkers = 0;
+    atomic_flag_clear_explicit(&pool->busy, memory_order_release);
+}
+
+/* Participants in a fork_join (1 when latency mode is off) */
+int latency_mode_threads(void) {
+    return atomic_load_explicit(&latency_threads, memory_order_relaxed);
+}
 
 // ============================================================================
-// HELPER FUNCTIONS
+// MODULAR REDUCTION
 // ============================================================================
+/*
+ * Q = 2^23 - 2^13 + 1, so 2^23 = 2^13 - 1 (mod Q). Writing x = hi*2^23 + lo
+ * gives the fold
+ *
+ *     x = (hi << 13) - hi + lo   (mod Q)
+ *
+ * which needs only a shift and two adders - no multiplier, which is what
+ * makes it attractive for the accelerator datapath. Bounds, for the input
+ * magnitude |x| < 2^48 (poly_multiply needs |r + a*b| < Q^2 + Q < 2^47):
+ *
+ *     stage   input bound        hi bound   output bound
+ *       1     2^48               2^25       2^38
+ *       2     2^38               2^15       2^28 + 2^23
+ *       3     2^28 + 2^23        2^5        2^23 + 2^18
+ *       4     2^23 + 2^18        1          2^23 + 2^13 - 1 < 2Q
+ *
+ * (each output is at most (2^13 - 1)*hi + 2^23 - 1), so one conditional
+ * subtraction of Q finishes the job. Negative inputs are reduced by
+ * magnitude and negated. The function below is written stage by stage so
+ * it doubles as the hardware model: four fold units of the widths above,
+ * a compare/subtract and a sign fix-up, all without multiplication.
+ */
+#define QINV 58728449             // Q^-1 mod 2^32 (Montgomery)
+#define BARRETT_M 8396807         // floor(2^46 / Q)
 
-/* Reduce coefficient modulo Q */
-int32_t reduce_mod_q(int64_t a) {
+/* Generic reduction with the C remainder operator */
+int32_t reduce_generic(int64_t a) {
     int32_t result = a % Q;
     if (result < 0) result += Q;
     return result;
 }
 
+/* One fold stage: 2^23 -> 2^13 - 1 */
+static inline uint64_t fold23(uint64_t x) {
+    uint64_t hi = x >> 23;
+    uint64_t lo = x & ((1u << 23) - 1);
+    return (hi << 13) - hi + lo;
+}
+
+/* Map r in [0, Q) to (-r mod Q) when a is negative, branch-free */
+static inline int32_t apply_sign(int32_t r, int64_t a) {
+    int32_t neg = (int32_t)(a >> 63);       // 0 or -1
+    r = (r ^ neg) - neg;
+    return r + ((r >> 31) & Q);
+}
+
+/* Shift-add reduction to [0, Q), valid for |a| < 2^48 */
+int32_t reduce_shift_add(int64_t a) {
+    uint64_t sign = (uint64_t)(a >> 63);
+    uint64_t x = ((uint64_t)a ^ sign) - sign;   // |a|
+
+    x = fold23(x);
+    x = fold23(x);
+    x = fold23(x);
+    x = fold23(x);
+
+    int32_t r = (int32_t)x - Q;
+    r += (r >> 31) & Q;
+    return apply_sign(r, a);
+}
+
+/* Barrett reduction to [0, Q), valid for |a| < 2^48 */
+int32_t reduce_barrett(int64_t a) {
+    uint64_t sign = (uint64_t)(a >> 63);
+    uint64_t x = ((uint64_t)a ^ sign) - sign;
+    uint64_t q = ((x >> 23) * BARRETT_M) >> 23;  // floor(x/Q) - {0,1,2}
+
+    int32_t r = (int32_t)(x - q * Q) - Q;
+    r += (r >> 31) & Q;
+    r -= Q;
+    r += (r >> 31) & Q;
+    return apply_sign(r, a);
+}
+
+/*
+ * Montgomery reduction: returns a * 2^-32 mod Q in (-Q, Q) for
+ * |a| < 2^31 * Q. Not a drop-in for reduce_mod_q (operands must live in
+ * the Montgomery domain); kept here as the baseline for comparisons.
+ */
+int32_t montgomery_reduce(int64_t a) {
+    int32_t t = (int32_t)((uint32_t)a * QINV);
+    return (int32_t)((a - (int64_t)t * Q) >> 32);
+}
+
+/*
+ * Reduce coefficient modulo Q. On CPUs with a fast multiplier the compiler
+ * already turns `%` by a constant into a Barrett-style multiply, which
+ * benchmarks faster than the fold chain, so shift-add is opt-in
+ * (-DREDUCE_SHIFT_ADD) for multiplier-light targets and datapath modelling.
+ */
+int32_t reduce_mod_q(int64_t a) {
+#ifdef REDUCE_SHIFT_ADD
+    return reduce_shift_add(a);
+#else
+    return reduce_generic(a);
+#endif
+}
+
 /* Initialize polynomial with zeros */
 void poly_zero(poly *p) {
     memset(p->coeffs, 0, N * sizeof(int32_t));
@@ -79,6 +389,27 @@ void poly_add(poly *r, const poly *a, const poly *b) {
     }
 }
 
+/* Polynomial subtraction: r = a - b (mod Q) */
+void poly_sub(poly *r, const poly *a, const poly *b) {
+    for (int i = 0; i < N; i++) {
+        r->coeffs[i] = reduce_mod_q((int64_t)a->coeffs[i] - b->coeffs[i]);
+    }
+}
+
+/* Coefficient-wise product: r[i] = a[i] * b[i] (mod Q) */
+void poly_pointwise_multiply(poly *r, const poly *a, const poly *b) {
+    for (int i = 0; i < N; i++) {
+        r->coeffs[i] = reduce_mod_q((int64_t)a->coeffs[i] * b->coeffs[i]);
+    }
+}
+
+/* Scale by 2^k: r = a * 2^k (mod Q) */
+void poly_shiftl(poly *r, const poly *a, unsigned k) {
+    for (int i = 0; i < N; i++) {
+        r->coeffs[i] = reduce_mod_q((int64_t)a->coeffs[i] * ((int64_t)1 << k));
+    }
+}
+
 /* Polynomial multiplication (NTT would be used in real implementation) */
 void poly_multiply(poly *r, const poly *a, const poly *b) {
     // Simplified convolution (real implementation uses NTT for speed)
@@ -98,45 +429,425 @@ void poly_multiply(poly *r, const poly *a, const poly *b) {
     }
 }
 
-/* Split polynomial into high and low bits */
+/* Split polynomial into high and low bits: t = t1*2^D + t0, t0 in (-2^(D-1), 2^(D-1)] */
 void poly_power2round(poly *t1, poly *t0, const poly *t) {
     for (int i = 0; i < N; i++) {
         int32_t c = t->coeffs[i];
-        int32_t mask = (1 << D) - 1;
-        t0->coeffs[i] = c & mask;
-        t1->coeffs[i] = (c - t0->coeffs[i]) >> D;
+        t1->coeffs[i] = (c + (1 << (D - 1)) - 1) >> D;
+        t0->coeffs[i] = c - (t1->coeffs[i] << D);
+    }
+}
+
+// ============================================================================
+// NUMBER THEORETIC TRANSFORM
+// ============================================================================
+/*
+ * Negacyclic NTT over Z_Q[x]/(x^256 + 1) with 1753 as the primitive 512th
+ * root of unity. zetas[k] = 2^32 * 1753^brv8(k) mod Q (centered), so each
+ * butterfly multiply goes through montgomery_reduce and NTT(a) itself
+ * carries no Montgomery factor. A pointwise_montgomery product then holds
+ * a*b*2^-32, which poly_invntt_tomont cancels with its final scaling.
+ *
+ * Output of poly_ntt is in bit-reversed order and bounded by |a| + 8Q; the
+ * inverse wants inputs below Q in magnitude and returns values in (-Q, Q).
+ */
+
+static const int32_t zetas[N] = {
+    0, 25847, -2608894, -518909, 237124, -777960, -876248, 466468,
+    1826347, 2353451, -359251, -2091905, 3119733, -2884855, 3111497, 2680103,
+    2725464, 1024112, -1079900, 3585928, -549488, -1119584, 2619752, -2108549,
+    -2118186, -3859737, -1399561, -3277672, 1757237, -19422, 4010497, 280005,
+    2706023, 95776, 3077325, 3530437, -1661693, -3592148, -2537516, 3915439,
+    -3861115, -3043716, 3574422, -2867647, 3539968, -300467, 2348700, -539299,
+    -1699267, -1643818, 3505694, -3821735, 3507263, -2140649, -1600420, 3699596,
+    811944, 531354, 954230, 3881043, 3900724, -2556880, 2071892, -2797779,
+    -3930395, -1528703, -3677745, -3041255, -1452451, 3475950, 2176455, -1585221,
+    -1257611, 1939314, -4083598, -1000202, -3190144, -3157330, -3632928, 126922,
+    3412210, -983419, 2147896, 2715295, -2967645, -3693493, -411027, -2477047,
+    -671102, -1228525, -22981, -1308169, -381987, 1349076, 1852771, -1430430,
+    -3343383, 264944, 508951, 3097992, 44288, -1100098, 904516, 3958618,
+    -3724342, -8578, 1653064, -3249728, 2389356, -210977, 759969, -1316856,
+    189548, -3553272, 3159746, -1851402, -2409325, -177440, 1315589, 1341330,
+    1285669, -1584928, -812732, -1439742, -3019102, -3881060, -3628969, 3839961,
+    2091667, 3407706, 2316500, 3817976, -3342478, 2244091, -2446433, -3562462,
+    266997, 2434439, -1235728, 3513181, -3520352, -3759364, -1197226, -3193378,
+    900702, 1859098, 909542, 819034, 495491, -1613174, -43260, -522500,
+    -655327, -3122442, 2031748, 3207046, -3556995, -525098, -768622, -3595838,
+    342297, 286988, -2437823, 4108315, 3437287, -3342277, 1735879, 203044,
+    2842341, 2691481, -2590150, 1265009, 4055324, 1247620, 2486353, 1595974,
+    -3767016, 1250494, 2635921, -3548272, -2994039, 1869119, 1903435, -1050970,
+    -1333058, 1237275, -3318210, -1430225, -451100, 1312455, 3306115, -1962642,
+    -1279661, 1917081, -2546312, -1374803, 1500165, 777191, 2235880, 3406031,
+    -542412, -2831860, -1671176, -1846953, -2584293, -3724270, 594136, -3776993,
+    -2013608, 2432395, 2454455, -164721, 1957272, 3369112, 185531, -1207385,
+    -3183426, 162844, 1616392, 3014001, 810149, 1652634, -3694233, -1799107,
+    -3038916, 3523897, 3866901, 269760, 2213111, -975884, 1717735, 472078,
+    -426683, 1723600, -1803090, 1910376, -1667432, -1104333, -260646, -3833893,
+    -2939036, -2235985, -420899, -2286327, 183443, -976891, 1612842, -3545687,
+    -554416, 3919660, -48306, -1362209, 3937738, 1400424, -846154, 1976782,
+};
+
+void poly_ntt(poly *a) {
+    int k = 0;
+
+    for (int len = 128; len > 0; len >>= 1) {
+        for (int start = 0; start < N; start += 2 * len) {
+            int32_t zeta = zetas[++k];
+            for (int j = start; j < start + len; j++) {
+                int32_t t = montgomery_reduce((int64_t)zeta * a->coeffs[j + len]);
+                a->coeffs[j + len] = a->coeffs[j] - t;
+                a->coeffs[j] = a->coeffs[j] + t;
+            }
+        }
+    }
+}
+
+void poly_invntt_tomont(poly *a) {
+    const int32_t f = 41978;    // 2^64 / 256 mod Q
+    int k = N;
+
+    for (int len = 1; len < N; len <<= 1) {
+        for (int start = 0; start < N; start += 2 * len) {
+            int32_t zeta = -zetas[--k];
+            for (int j = start; j < start + len; j++) {
+                int32_t t = a->coeffs[j];
+                a->coeffs[j] = t + a->coeffs[j + len];
+                a->coeffs[j + len] = montgomery_reduce(
+                    (int64_t)zeta * (t - a->coeffs[j + len]));
+            }
+        }
+    }
+    for (int j = 0; j < N; j++) {
+        a->coeffs[j] = montgomery_reduce((int64_t)f * a->coeffs[j]);
+    }
+}
+
+/*
+ * The same transforms over SHAKE_LANES polys at once: every butterfly is
+ * applied to all lanes before moving on ("vertical" vectorization), so
+ * the lane loop is the innermost one and shares each zeta load.
+ */
+void poly_ntt_x4(poly *const a[SHAKE_LANES]) {
+    int k = 0;
+
+    for (int len = 128; len > 0; len >>= 1) {
+        for (int start = 0; start < N; start += 2 * len) {
+            int32_t zeta = zetas[++k];
+            for (int j = start; j < start + len; j++) {
+                for (int l = 0; l < SHAKE_LANES; l++) {
+                    int32_t *c = a[l]->coeffs;
+                    int32_t t = montgomery_reduce((int64_t)zeta * c[j + len]);
+                    c[j + len] = c[j] - t;
+                    c[j] = c[j] + t;
+                }
+            }
+        }
+    }
+}
+
+void poly_invntt_tomont_x4(poly *const a[SHAKE_LANES]) {
+    const int32_t f = 41978;    // 2^64 / 256 mod Q
+    int k = N;
+
+    for (int len = 1; len < N; len <<= 1) {
+        for (int start = 0; start < N; start += 2 * len) {
+            int32_t zeta = -zetas[--k];
+            for (int j = start; j < start + len; j++) {
+                for (int l = 0; l < SHAKE_LANES; l++) {
+                    int32_t *c = a[l]->coeffs;
+                    int32_t t = c[j];
+                    c[j] = t + c[j + len];
+                    c[j + len] = montgomery_reduce((int64_t)zeta * (t - c[j + len]));
+                }
+            }
+        }
+    }
+    for (int l = 0; l < SHAKE_LANES; l++) {
+        for (int j = 0; j < N; j++) {
+            a[l]->coeffs[j] = montgomery_reduce((int64_t)f * a[l]->coeffs[j]);
+        }
+    }
+}
+
+/* c = a * b * 2^-32 coefficient-wise (NTT domain) */
+void poly_pointwise_montgomery(poly *c, const poly *a, const poly *b) {
+    for (int i = 0; i < N; i++) {
+        c->coeffs[i] = montgomery_reduce((int64_t)a->coeffs[i] * b->coeffs[i]);
+    }
+}
+
+/* Canonical [0, Q) representative of every coefficient */
+void poly_reduce(poly *a) {
+    for (int i = 0; i < N; i++) {
+        a->coeffs[i] = reduce_mod_q(a->coeffs[i]);
+    }
+}
+
+// ============================================================================
+// BIT PACKING
+// ============================================================================
+// pack_block8 / unpack_block8 live in Dilithium_key_gen.h so the signature
+// packers share them.
+
+/* t1: coefficients in [0, 2^10) */
+void polyt1_pack(uint8_t *r, const poly *a) {
+    for (int i = 0; i < N / 8; i++) {
+        pack_block8(r + 10 * i, (const uint32_t *)&a->coeffs[8 * i], 10);
+    }
+}
+
+void polyt1_unpack(poly *r, const uint8_t *a) {
+    for (int i = 0; i < N / 8; i++) {
+        unpack_block8((uint32_t *)&r->coeffs[8 * i], a + 10 * i, 10);
+    }
+}
+
+/* t0: coefficients in (-2^(D-1), 2^(D-1)], stored as 2^(D-1) - c */
+void polyt0_pack(uint8_t *r, const poly *a) {
+    for (int i = 0; i < N / 8; i++) {
+        uint32_t t[8];
+        for (int j = 0; j < 8; j++) {
+            t[j] = (1 << (D - 1)) - a->coeffs[8 * i + j];
+        }
+        pack_block8(r + D * i, t, D);
+    }
+}
+
+void polyt0_unpack(poly *r, const uint8_t *a) {
+    for (int i = 0; i < N / 8; i++) {
+        uint32_t t[8];
+        unpack_block8(t, a + D * i, D);
+        for (int j = 0; j < 8; j++) {
+            r->coeffs[8 * i + j] = (1 << (D - 1)) - (int32_t)t[j];
+        }
+    }
+}
+
+/* s1/s2: coefficients in [-ETA, ETA], stored as ETA - c */
+void polyeta_pack(uint8_t *r, const poly *a) {
+    for (int i = 0; i < N / 8; i++) {
+        uint32_t t[8];
+        for (int j = 0; j < 8; j++) {
+            t[j] = ETA - a->coeffs[8 * i + j];
+        }
+        pack_block8(r + 3 * i, t, 3);
+    }
+}
+
+void polyeta_unpack(poly *r, const uint8_t *a) {
+    for (int i = 0; i < N / 8; i++) {
+        uint32_t t[8];
+        unpack_block8(t, a + 3 * i, 3);
+        for (int j = 0; j < 8; j++) {
+            r->coeffs[8 * i + j] = ETA - (int32_t)t[j];
+        }
+    }
+}
+
+/*
+ * Fused power2round + pack: reads t once and writes the packed t1 and t0
+ * bytes directly. Each group of 8 coefficients is split in registers and
+ * handed to the block packers, so no full-size t1/t0 polys are ever built.
+ */
+void poly_power2round_pack(uint8_t *t1_bytes, uint8_t *t0_bytes, const poly *t) {
+    for (int i = 0; i < N / 8; i++) {
+        uint32_t hi[8], lo[8];
+        for (int j = 0; j < 8; j++) {
+            int32_t c = t->coeffs[8 * i + j];
+            int32_t c1 = (c + (1 << (D - 1)) - 1) >> D;
+            hi[j] = c1;
+            lo[j] = (1 << (D - 1)) - (c - (c1 << D));  // packed t0
+        }
+        pack_block8(t1_bytes + 10 * i, hi, 10);
+        pack_block8(t0_bytes + D * i, lo, D);
+    }
+}
+
+// ============================================================================
+// KEY (UN)PACKING
+// ============================================================================
+// pk = seed || t1
+// sk = seed || key || tr || s1 || s2 || t0
+
+void pack_pk(uint8_t pk_bytes[PUBLICKEYBYTES], const public_key *pk) {
+    memcpy(pk_bytes, pk->seed, SEEDBYTES);
+    for (int i = 0; i < K; i++) {
+        polyt1_pack(pk_bytes + SEEDBYTES + i * POLYT1_PACKEDBYTES, &pk->t1.vec[i]);
+    }
+}
+
+void unpack_pk(public_key *pk, const uint8_t pk_bytes[PUBLICKEYBYTES]) {
+    memcpy(pk->seed, pk_bytes, SEEDBYTES);
+    for (int i = 0; i < K; i++) {
+        polyt1_unpack(&pk->t1.vec[i], pk_bytes + SEEDBYTES + i * POLYT1_PACKEDBYTES);
+    }
+}
+
+void pack_sk(uint8_t sk_bytes[SECRETKEYBYTES], const secret_key *sk) {
+    uint8_t *p = sk_bytes;
+
+    memcpy(p, sk->seed, SEEDBYTES);
+    p += SEEDBYTES;
+    memcpy(p, sk->key, SEEDBYTES);
+    p += SEEDBYTES;
+    memcpy(p, sk->tr, TRBYTES);
+    p += TRBYTES;
+    for (int i = 0; i < L; i++, p += POLYETA_PACKEDBYTES) {
+        polyeta_pack(p, &sk->s1.vec[i]);
+    }
+    for (int i = 0; i < K; i++, p += POLYETA_PACKEDBYTES) {
+        polyeta_pack(p, &sk->s2.vec[i]);
+    }
+    for (int i = 0; i < K; i++, p += POLYT0_PACKEDBYTES) {
+        polyt0_pack(p, &sk->t0.vec[i]);
+    }
+}
+
+void unpack_sk(secret_key *sk, const uint8_t sk_bytes[SECRETKEYBYTES]) {
+    const uint8_t *p = sk_bytes;
+
+    memcpy(sk->seed, p, SEEDBYTES);
+    p += SEEDBYTES;
+    memcpy(sk->key, p, SEEDBYTES);
+    p += SEEDBYTES;
+    memcpy(sk->tr, p, TRBYTES);
+    p += TRBYTES;
+    for (int i = 0; i < L; i++, p += POLYETA_PACKEDBYTES) {
+        polyeta_unpack(&sk->s1.vec[i], p);
+    }
+    for (int i = 0; i < K; i++, p += POLYETA_PACKEDBYTES) {
+        polyeta_unpack(&sk->s2.vec[i], p);
+    }
+    for (int i = 0; i < K; i++, p += POLYT0_PACKEDBYTES) {
+        polyt0_unpack(&sk->t0.vec[i], p);
     }
 }
 
 // ============================================================================
 // CRYPTOGRAPHIC PRIMITIVES (Simplified)
 // ============================================================================
+// Hashing uses the SHAKE-256 sponge from SHAKE.c; the samplers below keep
+// their simplified (non-rejection) mappings from the hash output.
 
-/* 
- * In real Dilithium, this uses SHAKE-128/256
- * Here we use a simplified pseudo-random generator for illustration
+// ============================================================================
+// RANDOMNESS POOL
+// ============================================================================
+/*
+ * One pool per thread, so handing out bytes takes no lock: a buffer of
+ * getrandom() output refilled a budget's worth at a time, which spreads
+ * one syscall over many rnd values. The bytes are served as the kernel
+ * produced them (its generator outruns a SHAKE-based one here), and each
+ * served byte is wiped from the buffer. A forked child must not replay
+ * its parent's unserved bytes: a pthread_atfork hook bumps
+ * fork_generation, and a pool filled under an older generation is
+ * discarded before it serves anything.
  */
-void shake256(uint8_t *output, size_t outlen, const uint8_t *input, size_t inlen) {
-    // This is a PLACEHOLDER - use a real SHAKE implementation
-    // For education: just XOR with counter
-    for (size_t i = 0; i < outlen; i++) {
-        output[i] = input[i % inlen] ^ (i & 0xFF);
+typedef struct {
+    uint8_t buf[RNG_POOL_BYTES];
+    size_t pos;                // Next unserved byte of buf
+    size_t len;                // Bytes of buf filled by the last draw
+    size_t reseeds;            // OS draws made by this thread
+    unsigned generation;       // fork_generation at the last draw
+} rng_pool;
+
+static _Thread_local rng_pool pool;
+static atomic_size_t rng_budget = RNG_POOL_BYTES;
+static atomic_uint fork_generation;
+static pthread_once_t rng_once = PTHREAD_ONCE_INIT;
+
+static void rng_on_fork(void) {
+    atomic_fetch_add(&fork_generation, 1);
+}
+
+static void rng_register_fork(void) {
+    pthread_atfork(NULL, NULL, rng_on_fork);
+}
+
+static int rng_refill(rng_pool *p) {
+    size_t want = atomic_load(&rng_budget), got = 0;
+
+    while (got < want) {
+        ssize_t r = getrandom(p->buf + got, want - got, 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "getrandom failed: %s\n", strerror(errno));
+            return -1;
+        }
+        got += (size_t)r;
     }
+
+    p->pos = 0;
+    p->len = want;
+    p->reseeds++;
+    p->generation = atomic_load(&fork_generation);
+    return 0;
+}
+
+/* Fill out with len random bytes; -1 if the OS source failed */
+int rng_bytes(uint8_t *out, size_t len) {
+    rng_pool *p = &pool;
+
+    pthread_once(&rng_once, rng_register_fork);
+    if (p->generation != atomic_load(&fork_generation)) {
+        memset(p->buf, 0, sizeof(p->buf));
+        p->pos = p->len = 0;
+    }
+
+    while (len) {
+        if (p->pos == p->len && rng_refill(p)) return -1;
+
+        size_t n = p->len - p->pos;
+        if (n > len) n = len;
+        memcpy(out, p->buf + p->pos, n);
+        memset(p->buf + p->pos, 0, n);     // Served bytes leave the pool
+        p->pos += n;
+        out += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* count seeds (or rnd values) in one call, for batch signing */
+int rng_seeds(uint8_t (*seeds)[SEEDBYTES], size_t count) {
+    return rng_bytes(seeds[0], count * SEEDBYTES);
+}
+
+/*
+ * Bytes served per OS draw, clamped to [SEEDBYTES, RNG_POOL_BYTES]. Every
+ * draw is fresh kernel output, so this is also the reseed interval:
+ * smaller means fresher bytes and more syscalls. Takes effect at each
+ * thread's next refill.
+ */
+void rng_set_reseed_budget(size_t bytes) {
+    if (bytes < SEEDBYTES) bytes = SEEDBYTES;
+    if (bytes > RNG_POOL_BYTES) bytes = RNG_POOL_BYTES;
+    atomic_store(&rng_budget, bytes);
+}
+
+size_t rng_reseeds(void) {
+    return pool.reseeds;
 }
 
-/* Generate random seed */
+/* Generate random seed; key material never falls back to a weak source */
 void random_seed(uint8_t *seed) {
-    // In production: use OS random number generator
-    // For demo: simplified
-    for (int i = 0; i < SEEDBYTES; i++) {
-        seed[i] = rand() & 0xFF;
+    if (rng_bytes(seed, SEEDBYTES)) {
+        fprintf(stderr, "No OS randomness for key generation\n");
+        abort();
     }
 }
 
+/* Clear secrets from memory that is about to go out of scope; unlike a
+ * plain memset this is not dropped as a dead store */
+void secure_wipe(void *p, size_t len) {
+    explicit_bzero(p, len);
+}
+
 /* Sample small polynomial with coefficients in [-ETA, ETA] */
 void sample_small_poly(poly *p, const uint8_t *seed, uint16_t nonce) {
     // Simplified sampling - real version uses rejection sampling
-    uint8_t buf[N * 2];
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    uint8_t *buf = arena_alloc(arena, N * 2);
     uint8_t expanded_seed[SEEDBYTES + 2];
     
     memcpy(expanded_seed, seed, SEEDBYTES);
@@ -150,98 +861,398 @@ void sample_small_poly(poly *p, const uint8_t *seed, uint16_t nonce) {
         int32_t val = (buf[i] % (2 * ETA + 1)) - ETA;
         p->coeffs[i] = val;
     }
+
+    arena_restore(arena, mark);
 }
 
-/* Expand seed into matrix A (k x l matrix of polynomials) */
-void expand_matrix_a(poly A[K][L], const uint8_t *seed) {
-    for (int i = 0; i < K; i++) {
-        for (int j = 0; j < L; j++) {
-            uint8_t expanded[SEEDBYTES + 2];
-            memcpy(expanded, seed, SEEDBYTES);
-            expanded[SEEDBYTES] = i;
-            expanded[SEEDBYTES + 1] = j;
-            
-            uint8_t poly_seed[N * 4];
-            shake256(poly_seed, N * 4, expanded, SEEDBYTES + 2);
-            
-            // Convert bytes to polynomial coefficients
-            for (int k = 0; k < N; k++) {
-                uint32_t val = 0;
-                for (int b = 0; b < 3; b++) {
-                    val |= ((uint32_t)poly_seed[k * 3 + b]) << (8 * b);
-                }
-                A[i][j].coeffs[k] = val % Q;
-            }
+/* Expand one entry A[i][j] of the public matrix */
+void expand_matrix_entry(poly *a, const uint8_t *seed, int i, int j) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    uint8_t *poly_seed = arena_alloc(arena, N * 4);
+    uint8_t expanded[SEEDBYTES + 2];
+    
+    memcpy(expanded, seed, SEEDBYTES);
+    expanded[SEEDBYTES] = i;
+    expanded[SEEDBYTES + 1] = j;
+    
+    shake256(poly_seed, N * 4, expanded, SEEDBYTES + 2);
+    
+    // Convert bytes to polynomial coefficients
+    for (int k = 0; k < N; k++) {
+        uint32_t val = 0;
+        for (int b = 0; b < 3; b++) {
+            val |= ((uint32_t)poly_seed[k * 3 + b]) << (8 * b);
+        }
+        a->coeffs[k] = val % Q;
+    }
+
+    arena_restore(arena, mark);
+}
+
+/*
+ * Entry (i, j) of SHAKE_LANES different matrices, one seed per lane, with
+ * all lanes hashed by one four-way SHAKE-256. Only the 3*N bytes the
+ * sampler reads are squeezed (a prefix of expand_matrix_entry's stream,
+ * so the results are identical).
+ */
+void expand_matrix_entry_x4(poly *const a[SHAKE_LANES],
+                            const uint8_t *const seeds[SHAKE_LANES], int i, int j) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    uint8_t *buf = arena_alloc(arena, SHAKE_LANES * N * 3);
+    uint8_t in[SHAKE_LANES][SEEDBYTES + 2];
+    const uint8_t *inputs[SHAKE_LANES];
+    uint8_t *outputs[SHAKE_LANES];
+
+    for (int l = 0; l < SHAKE_LANES; l++) {
+        memcpy(in[l], seeds[l], SEEDBYTES);
+        in[l][SEEDBYTES] = i;
+        in[l][SEEDBYTES + 1] = j;
+        inputs[l] = in[l];
+        outputs[l] = buf + l * N * 3;
+    }
+    shake256x4(outputs, N * 3, inputs, SEEDBYTES + 2);
+
+    for (int l = 0; l < SHAKE_LANES; l++) {
+        for (int k = 0; k < N; k++) {
+            const uint8_t *p = outputs[l] + 3 * k;
+            uint32_t val = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+            a[l]->coeffs[k] = val % Q;
         }
     }
+
+    arena_restore(arena, mark);
+}
+
+typedef struct {
+    poly (*A)[L];
+    const uint8_t *seed;
+} expand_job;
+
+static void expand_task(void *arg, int index) {
+    expand_job *job = arg;
+    int i = index / L, j = index % L;
+    expand_matrix_entry(&job->A[i][j], job->seed, i, j);
+}
+
+/* Expand seed into matrix A (k x l matrix of polynomials) */
+void expand_matrix_a(poly A[K][L], const uint8_t *seed) {
+    expand_job job = { A, seed };
+    fork_join(expand_task, &job, K * L);
 }
 
 // ============================================================================
 // MATRIX-VECTOR OPERATIONS
 // ============================================================================
 
+/* One row of A * s1: r = sum_j A[i][j] * s1[j] */
+void matrix_vector_row(poly *r, const poly A_row[L], const polyvecl *s1) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    poly *temp = arena_poly(arena);
+
+    poly_zero(r);
+    for (int j = 0; j < L; j++) {
+        poly_multiply(temp, &A_row[j], &s1->vec[j]);
+        poly_add(r, r, temp);
+    }
+
+    arena_restore(arena, mark);
+}
+
+typedef struct {
+    polyveck *result;
+    poly (*A)[L];
+    const polyvecl *s1;
+} mv_job;
+
+static void mv_task(void *arg, int i) {
+    mv_job *job = arg;
+    matrix_vector_row(&job->result->vec[i], job->A[i], job->s1);
+}
+
 /* Matrix-vector multiplication: result = A * s1 (k x l matrix times l vector) */
 void matrix_vector_multiply(polyveck *result, poly A[K][L], const polyvecl *s1) {
-    for (int i = 0; i < K; i++) {
-        poly_zero(&result->vec[i]);
-        for (int j = 0; j < L; j++) {
-            poly temp;
-            poly_multiply(&temp, &A[i][j], &s1->vec[j]);
-            poly_add(&result->vec[i], &result->vec[i], &temp);
-        }
-    }
+    mv_job job = { result, A, s1 };
+    fork_join(mv_task, &job, K);
 }
 
 // ============================================================================
 // KEY GENERATION - MAIN ALGORITHM
 // ============================================================================
 
-void dilithium_keygen(public_key *pk, secret_key *sk) {
-    poly A[K][L];              // Public matrix
-    polyveck t;                // t = A*s1 + s2
-    uint8_t secret_seed[SEEDBYTES];
+/*
+ * Steps 1-5, shared by every keygen entry point. All key material is a
+ * function of the 32-byte master seed xi: SHAKE-256(xi) splits into rho
+ * (public seed for A), the seed s1 and s2 are sampled from, and K. A key
+ * can therefore be stored as xi alone and rebuilt whenever it is needed.
+ */
+static void keygen_compute_t(const uint8_t xi[SEEDBYTES], uint8_t seed[SEEDBYTES],
+                             uint8_t key[SEEDBYTES], poly A[K][L], polyvecl *s1,
+                             polyveck *s2, polyveck *t, int verbose) {
+    uint8_t seedbuf[3 * SEEDBYTES];
+    const uint8_t *secret_seed = seedbuf + SEEDBYTES;
     
-    printf("Step 1: Generating random seed...\n");
-    random_seed(pk->seed);
-    random_seed(secret_seed);
+    if (verbose) printf("Step 1: Expanding master seed into rho, rho' and K...\n");
+    shake256(seedbuf, sizeof(seedbuf), xi, SEEDBYTES);
+    memcpy(seed, seedbuf, SEEDBYTES);
+    memcpy(key, seedbuf + 2 * SEEDBYTES, SEEDBYTES);
     
-    printf("Step 2: Expanding seed into matrix A (%dx%d)...\n", K, L);
-    expand_matrix_a(A, pk->seed);
+    if (verbose) printf("Step 2: Expanding seed into matrix A (%dx%d)...\n", K, L);
+    expand_matrix_a(A, seed);
     
-    printf("Step 3: Sampling secret vector s1 (length %d)...\n", L);
+    if (verbose) printf("Step 3: Sampling secret vector s1 (length %d)...\n", L);
     for (int i = 0; i < L; i++) {
-        sample_small_poly(&sk->s1.vec[i], secret_seed, i);
+        sample_small_poly(&s1->vec[i], secret_seed, i);
     }
     
-    printf("Step 4: Sampling secret vector s2 (length %d)...\n", K);
+    if (verbose) printf("Step 4: Sampling secret vector s2 (length %d)...\n", K);
     for (int i = 0; i < K; i++) {
-        sample_small_poly(&sk->s2.vec[i], secret_seed, L + i);
+        sample_small_poly(&s2->vec[i], secret_seed, L + i);
     }
     
-    printf("Step 5: Computing t = A * s1 + s2...\n");
-    matrix_vector_multiply(&t, A, &sk->s1);
+    if (verbose) printf("Step 5: Computing t = A * s1 + s2...\n");
+    matrix_vector_multiply(t, A, s1);
     for (int i = 0; i < K; i++) {
-        poly_add(&t.vec[i], &t.vec[i], &sk->s2.vec[i]);
+        poly_add(&t->vec[i], &t->vec[i], &s2->vec[i]);
     }
+    secure_wipe(seedbuf, sizeof(seedbuf));
+}
+
+/*
+ * Pairwise consistency test hook, run after every keygen while set. The
+ * test itself (sign and verify) lives with the signer; it gets the
+ * keygen's own A so it does not have to expand it again. A key that
+ * fails is never returned.
+ */
+static keygen_pct_fn pct_hook = NULL;
+
+void keygen_set_pct(keygen_pct_fn fn) {
+    pct_hook = fn;
+}
+
+static void keygen_run_pct(const poly A[K][L], const public_key *pk,
+                           const secret_key *sk) {
+    if (pct_hook && pct_hook(A, pk, sk) != 0) {
+        fprintf(stderr, "Pairwise consistency test failed; key discarded\n");
+        abort();
+    }
+}
+
+/* Steps 6-7 for the unpacked key forms */
+static void keygen_finish(public_key *pk, secret_key *sk, const polyveck *t) {
+    uint8_t pk_bytes[PUBLICKEYBYTES];
     
-    printf("Step 6: Splitting t into high (t1) and low (t0) bits...\n");
     for (int i = 0; i < K; i++) {
-        poly_power2round(&pk->t1.vec[i], &sk->t0.vec[i], &t.vec[i]);
+        poly_power2round(&pk->t1.vec[i], &sk->t0.vec[i], &t->vec[i]);
     }
-    
-    printf("Step 7: Packaging keys...\n");
     memcpy(sk->seed, pk->seed, SEEDBYTES);
+    pack_pk(pk_bytes, pk);
+    shake256(sk->tr, TRBYTES, pk_bytes, PUBLICKEYBYTES);
+}
+
+void dilithium_keygen(public_key *pk, secret_key *sk) {
+    poly A[K][L];              // Public matrix
+    polyveck t;                // t = A*s1 + s2
+    uint8_t xi[SEEDBYTES];
+    
+    random_seed(xi);
+    keygen_compute_t(xi, pk->seed, sk->key, A, &sk->s1, &sk->s2, &t, 1);
+    secure_wipe(xi, sizeof(xi));
+    
+    printf("Steps 6-7: Splitting t into t1/t0, packaging keys (tr = H(pk))...\n");
+    keygen_finish(pk, sk, &t);
+    keygen_run_pct((const poly (*)[L])A, pk, sk);
     
     printf("\n✓ Key generation complete!\n");
     printf("  Public key size: ~%zu bytes\n", 
            SEEDBYTES + K * N * sizeof(int32_t) / 8);
     printf("  Secret key size: ~%zu bytes\n", 
            SEEDBYTES + (L + 2*K) * N * sizeof(int32_t) / 8);
+    printf("  Scratch arena peak: %zu of %d bytes\n",
+           scratch_arena()->peak, SCRATCH_BYTES);
+}
+
+/* Deterministic, silent key generation: the same xi always gives the same keys */
+void dilithium_keygen_from_seed(public_key *pk, secret_key *sk,
+                                const uint8_t xi[SEEDBYTES]) {
+    poly A[K][L];
+    polyveck t;
+    
+    keygen_compute_t(xi, pk->seed, sk->key, A, &sk->s1, &sk->s2, &t, 0);
+    keygen_finish(pk, sk, &t);
+    keygen_run_pct((const poly (*)[L])A, pk, sk);
+}
+
+/*
+ * Rebuild a key that keygen already produced (and tested) from its xi, for
+ * callers that keep only the seed. No PCT; A is handed back for reuse.
+ */
+void dilithium_keygen_rederive(public_key *pk, secret_key *sk, poly A[K][L],
+                               const uint8_t xi[SEEDBYTES]) {
+    polyveck t;
+    
+    keygen_compute_t(xi, pk->seed, sk->key, A, &sk->s1, &sk->s2, &t, 0);
+    keygen_finish(pk, sk, &t);
+}
+
+/* Steps 1-7 straight to the packed formats (t1/t0 never unpacked) */
+static void keygen_packed(uint8_t pk_bytes[PUBLICKEYBYTES],
+                          uint8_t sk_bytes[SECRETKEYBYTES],
+                          const uint8_t xi[SEEDBYTES], int verbose) {
+    poly A[K][L];
+    polyvecl s1;
+    polyveck s2, t;
+    uint8_t *sk_key = sk_bytes + SEEDBYTES;
+    uint8_t *sk_tr = sk_key + SEEDBYTES;
+    uint8_t *sk_s1 = sk_tr + TRBYTES;
+    uint8_t *sk_s2 = sk_s1 + L * POLYETA_PACKEDBYTES;
+    uint8_t *sk_t0 = sk_s2 + K * POLYETA_PACKEDBYTES;
+    
+    keygen_compute_t(xi, pk_bytes, sk_key, A, &s1, &s2, &t, verbose);
+    
+    if (verbose) printf("Step 6: Fused power2round + pack of t1 and t0...\n");
+    for (int i = 0; i < K; i++) {
+        poly_power2round_pack(pk_bytes + SEEDBYTES + i * POLYT1_PACKEDBYTES,
+                              sk_t0 + i * POLYT0_PACKEDBYTES, &t.vec[i]);
+    }
+    
+    if (verbose) printf("Step 7: Packing s1, s2, seed and tr = H(pk)...\n");
+    memcpy(sk_bytes, pk_bytes, SEEDBYTES);
+    shake256(sk_tr, TRBYTES, pk_bytes, PUBLICKEYBYTES);
+    for (int i = 0; i < L; i++) {
+        polyeta_pack(sk_s1 + i * POLYETA_PACKEDBYTES, &s1.vec[i]);
+    }
+    for (int i = 0; i < K; i++) {
+        polyeta_pack(sk_s2 + i * POLYETA_PACKEDBYTES, &s2.vec[i]);
+    }
+    
+    // The test works on the struct forms; unpacking is bit shuffling only
+    if (pct_hook) {
+        struct { public_key pk; secret_key sk; } *keys = malloc(sizeof(*keys));
+        if (!keys) abort();
+        unpack_pk(&keys->pk, pk_bytes);
+        unpack_sk(&keys->sk, sk_bytes);
+        keygen_run_pct((const poly (*)[L])A, &keys->pk, &keys->sk);
+        secure_wipe(&keys->sk, sizeof(keys->sk));
+        free(keys);
+    }
+    secure_wipe(&s1, sizeof(s1));
+    secure_wipe(&s2, sizeof(s2));
+    secure_wipe(&t, sizeof(t));
+}
+
+void dilithium_keygen_packed_from_seed(uint8_t pk_bytes[PUBLICKEYBYTES],
+                                       uint8_t sk_bytes[SECRETKEYBYTES],
+                                       const uint8_t xi[SEEDBYTES]) {
+    keygen_packed(pk_bytes, sk_bytes, xi, 0);
+}
+
+void dilithium_keygen_packed(uint8_t pk_bytes[PUBLICKEYBYTES],
+                             uint8_t sk_bytes[SECRETKEYBYTES]) {
+    uint8_t xi[SEEDBYTES];
+    
+    random_seed(xi);
+    keygen_packed(pk_bytes, sk_bytes, xi, 1);
+    secure_wipe(xi, sizeof(xi));
+    
+    printf("\n✓ Packed key generation complete!\n");
+    printf("  Public key: %d bytes, secret key: %d bytes\n",
+           PUBLICKEYBYTES, SECRETKEYBYTES);
+}
+
+// ============================================================================
+// BENCHMARK AND SELF-TEST HELPERS
+// ============================================================================
+
+/* Monotonic clock in nanoseconds */
+double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* xorshift64 - deterministic test inputs, not for key material */
+static uint64_t test_rng_state = 0x9E3779B97F4A7C15ULL;
+
+uint64_t test_rand64(void) {
+    test_rng_state ^= test_rng_state << 13;
+    test_rng_state ^= test_rng_state >> 7;
+    test_rng_state ^= test_rng_state << 17;
+    return test_rng_state;
+}
+
+/*
+ * Check the reduction backends against the generic `%` over the inputs
+ * the arithmetic actually produces (exhaustively for poly_add's (-2Q, 3Q),
+ * randomly plus both ends for poly_multiply's |r + a*b| <= (Q-1)^2 + Q),
+ * then time each one over the same product-range inputs.
+ */
+void reduction_selftest_and_bench(void) {
+    const int64_t prod_max = (int64_t)(Q - 1) * (Q - 1) + Q;
+    long mismatches = 0;
+
+    for (int64_t a = -2 * (int64_t)Q; a < 3 * (int64_t)Q; a++) {
+        int32_t g = reduce_generic(a);
+        mismatches += reduce_shift_add(a) != g;
+        mismatches += reduce_barrett(a) != g;
+    }
+    for (int i = 0; i < 1000000; i++) {
+        int64_t a = (int64_t)(test_rand64() % (2 * (uint64_t)prod_max + 1))
+                    - prod_max;
+        int64_t edge = (i & 1) ? prod_max - i / 2 : -(prod_max - i / 2);
+        int32_t g = reduce_generic(a);
+        mismatches += reduce_shift_add(a) != g;
+        mismatches += reduce_barrett(a) != g;
+        // montgomery_reduce(a) * 2^32 must give a back
+        mismatches += reduce_generic((int64_t)montgomery_reduce(a) *
+                                     (((int64_t)1 << 32) % Q)) != g;
+        g = reduce_generic(edge);
+        mismatches += reduce_shift_add(edge) != g;
+        mismatches += reduce_barrett(edge) != g;
+    }
+    printf("Reduction backends agree with generic %%: %s\n",
+           mismatches == 0 ? "✓ YES" : "✗ NO");
+
+    // Benchmark over product-range inputs
+    enum { COUNT = 4096, ROUNDS = 512 };
+    static int64_t in[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        in[i] = (int64_t)(test_rand64() % (2 * (uint64_t)prod_max + 1))
+                - prod_max;
+    }
+
+    struct {
+        const char *name;
+        int32_t (*fn)(int64_t);
+    } backends[] = {
+        { "generic %  ", reduce_generic },
+        { "shift-add  ", reduce_shift_add },
+        { "Barrett    ", reduce_barrett },
+        { "Montgomery ", montgomery_reduce },
+    };
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        volatile int32_t sink = 0;
+        int32_t acc = 0;
+        double start = now_ns();
+        for (int r = 0; r < ROUNDS; r++) {
+            for (int i = 0; i < COUNT; i++) {
+                acc ^= backends[b].fn(in[i]);
+            }
+        }
+        double ns = (now_ns() - start) / ((double)ROUNDS * COUNT);
+        sink = acc;
+        (void)sink;
+        printf("  %s %6.2f ns/op\n", backends[b].name, ns);
+    }
 }
 
 // ============================================================================
 // DEMO MAIN FUNCTION
 // ============================================================================
+#ifndef DILITHIUM_NO_MAIN
 
 int main() {
     public_key pk;
@@ -267,5 +1278,100 @@ int main() {
     }
     printf("\n");
     
+    // Same seeds through the fused packed path must give the same keys
+    printf("\n=== Packed Key Generation ===\n\n");
+    static uint8_t pk_bytes[PUBLICKEYBYTES], sk_bytes[SECRETKEYBYTES];
+    static uint8_t pk_ref[PUBLICKEYBYTES], sk_ref[SECRETKEYBYTES];
+    uint8_t xi[SEEDBYTES];
+    
+    dilithium_keygen_packed(pk_bytes, sk_bytes);
+    
+    random_seed(xi);
+    dilithium_keygen_from_seed(&pk, &sk, xi);
+    pack_pk(pk_ref, &pk);
+    pack_sk(sk_ref, &sk);
+    dilithium_keygen_packed_from_seed(pk_bytes, sk_bytes, xi);
+    
+    int consistent = memcmp(pk_bytes, pk_ref, PUBLICKEYBYTES) == 0 &&
+                     memcmp(sk_bytes, sk_ref, SECRETKEYBYTES) == 0;
+    printf("\nPacked keys match pack_pk/pack_sk of the struct keys: %s\n",
+           consistent ? "✓ YES" : "✗ NO");
+    
+    // Per-signature rnd: one syscall each vs the thread's pool
+    printf("\n=== Randomness Pool ===\n\n");
+    const int rng_reps = 20000;
+    uint8_t rnd[SEEDBYTES], child_rnd[SEEDBYTES];
+    
+    double start = now_ns();
+    for (int r = 0; r < rng_reps; r++) {
+        if (getrandom(rnd, SEEDBYTES, 0) != SEEDBYTES) break;
+    }
+    double sys_ns = (now_ns() - start) / rng_reps;
+    start = now_ns();
+    for (int r = 0; r < rng_reps; r++) {
+        rng_bytes(rnd, SEEDBYTES);
+    }
+    double pool_ns = (now_ns() - start) / rng_reps;
+    printf("  32 bytes via getrandom(): %6.0f ns\n", sys_ns);
+    printf("  32 bytes via rng_bytes(): %6.0f ns\n", pool_ns);
+    
+    // A forked child must not replay the parent's buffered bytes
+    int fds[2];
+    int forked = 0;
+    if (pipe(fds) == 0) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            rng_bytes(child_rnd, SEEDBYTES);
+            ssize_t w = write(fds[1], child_rnd, SEEDBYTES);
+            _exit(w == SEEDBYTES ? 0 : 1);
+        }
+        if (pid > 0) {
+            rng_bytes(rnd, SEEDBYTES);
+            forked = read(fds[0], child_rnd, SEEDBYTES) == SEEDBYTES;
+            waitpid(pid, NULL, 0);
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+    printf("  Child after fork draws different bytes: %s\n",
+           forked && memcmp(rnd, child_rnd, SEEDBYTES) != 0 ? "✓ YES" : "✗ NO");
+    
+    // Budget: an OS draw every 1 KiB served instead of every 4 KiB
+    static uint8_t drain[256 * 1024];
+    size_t reseeds = rng_reseeds();
+    rng_bytes(drain, sizeof(drain));
+    size_t default_draws = rng_reseeds() - reseeds;
+    rng_set_reseed_budget(1024);
+    reseeds = rng_reseeds();
+    rng_bytes(drain, sizeof(drain));
+    rng_set_reseed_budget(RNG_POOL_BYTES);
+    printf("  OS draws per 256 KiB: %zu at the default budget, %zu at 1 KiB\n",
+           default_draws, rng_reseeds() - reseeds);
+    
+    // Single-operation latency of the parallel stages vs thread count
+    printf("\n=== Latency Mode (expand A + A*s1) ===\n\n");
+    static poly A[K][L];
+    polyveck t;
+    for (int threads = 1; threads <= 4; threads++) {
+        const int reps = 5;
+        
+        latency_mode_enable(threads);
+        start = now_ns();
+        for (int r = 0; r < reps; r++) {
+            expand_matrix_a(A, pk.seed);
+            matrix_vector_multiply(&t, A, &sk.s1);
+        }
+        double us = (now_ns() - start) / 1e3 / reps;
+        latency_mode_disable();
+        
+        printf("  %d thread%s: %10.1f us\n", threads,
+               threads == 1 ? " " : "s", us);
+    }
+    
+    printf("\n=== Modular Reduction (Q = 2^23 - 2^13 + 1) ===\n\n");
+    reduction_selftest_and_bench();
+    
     return 0;
 }
+
+#endif
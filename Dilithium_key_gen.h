@@ -0,0 +1,230 @@
+/*
+ * Dilithium Key Generation - Educational Implementation
+ * Parameters, types and entry points of Dilithium_key_gen.c, for code
+ * that embeds it (compile the .c with -DDILITHIUM_NO_MAIN to drop the demo;
+ * it links against SHAKE.c for hashing)
+ */
+
+#ifndef DILITHIUM_KEY_GEN_H
+#define DILITHIUM_KEY_GEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SHAKE.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ============================================================================
+// PARAMETERS (Dilithium2 variant)
+// ============================================================================
+#define Q 8380417          // Prime modulus
+#define N 256              // Polynomial degree
+#define K 4                // Matrix height
+#define L 4                // Matrix width
+#define ETA 2              // Secret coefficient bound
+#define D 13               // Dropped bits from t
+#define SEEDBYTES 32       // Seed size
+#define TRBYTES 64         // tr = H(pk)
+#define POLYBYTES 32       // Bytes per polynomial coefficient range
+
+// Packed (wire) sizes
+#define POLYT1_PACKEDBYTES  (N * 10 / 8)   // t1: 10 bits per coefficient
+#define POLYT0_PACKEDBYTES  (N * D / 8)    // t0: 13 bits per coefficient
+#define POLYETA_PACKEDBYTES (N * 3 / 8)    // s1/s2: 3 bits per coefficient
+#define PUBLICKEYBYTES (SEEDBYTES + K * POLYT1_PACKEDBYTES)
+#define SECRETKEYBYTES (2 * SEEDBYTES + TRBYTES \
+                        + (L + K) * POLYETA_PACKEDBYTES + K * POLYT0_PACKEDBYTES)
+
+// ============================================================================
+// POLYNOMIAL STRUCTURE
+// ============================================================================
+typedef struct {
+    int32_t coeffs[N];     // 256 coefficients, each mod Q
+} poly;
+
+typedef struct {
+    poly vec[K];           // Vector of K polynomials
+} polyveck;
+
+typedef struct {
+    poly vec[L];           // Vector of L polynomials
+} polyvecl;
+
+// ============================================================================
+// KEY STRUCTURES
+// ============================================================================
+typedef struct {
+    uint8_t seed[SEEDBYTES];  // Seed for generating A
+    polyveck t1;               // High bits of t
+} public_key;
+
+typedef struct {
+    uint8_t seed[SEEDBYTES];  // Seed for generating A
+    uint8_t key[SEEDBYTES];   // Signing key K (seeds the mask)
+    uint8_t tr[TRBYTES];      // H(packed public key)
+    polyvecl s1;               // Secret vector 1
+    polyveck s2;               // Secret vector 2
+    polyveck t0;               // Low bits of t
+} secret_key;
+
+// ============================================================================
+// SCRATCH ARENA AND FORK-JOIN
+// ============================================================================
+#define ARENA_ALIGN 64             // Cache line (and widest SIMD register)
+
+typedef struct {
+    uint8_t *base;             // Start of buffer (ARENA_ALIGN aligned)
+    size_t size;               // Usable bytes
+    size_t used;               // Current bump offset
+    size_t peak;               // High-water mark of used
+} poly_arena;
+
+typedef size_t arena_mark;     // Saved bump offset for scoped reset
+
+void arena_init(poly_arena *a, void *buf, size_t size);
+void *arena_alloc(poly_arena *a, size_t bytes);
+arena_mark arena_save(const poly_arena *a);
+void arena_restore(poly_arena *a, arena_mark m);
+poly *arena_poly(poly_arena *a);
+polyveck *arena_polyveck(poly_arena *a);
+polyvecl *arena_polyvecl(poly_arena *a);
+poly_arena *scratch_arena(void);
+
+typedef void (*fj_task)(void *arg, int index);
+
+void fork_join(fj_task fn, void *arg, int count);
+void fork_join_run_inline(void);
+void latency_mode_enable(int threads);
+void latency_mode_disable(void);
+int latency_mode_threads(void);
+
+// ============================================================================
+// RANDOMNESS POOL
+// ============================================================================
+// Lock-free per-thread pool over getrandom(); refills on fork and budget
+#define RNG_POOL_BYTES 4096            // Largest (and default) reseed budget
+
+int rng_bytes(uint8_t *out, size_t len);
+int rng_seeds(uint8_t (*seeds)[SEEDBYTES], size_t count);
+void rng_set_reseed_budget(size_t bytes);
+size_t rng_reseeds(void);              // OS draws by the calling thread
+
+// ============================================================================
+// ARITHMETIC
+// ============================================================================
+int32_t reduce_mod_q(int64_t a);
+int32_t reduce_generic(int64_t a);
+int32_t reduce_shift_add(int64_t a);
+int32_t reduce_barrett(int64_t a);
+int32_t montgomery_reduce(int64_t a);
+
+void poly_zero(poly *p);
+void poly_copy(poly *dst, const poly *src);
+void poly_add(poly *r, const poly *a, const poly *b);
+void poly_sub(poly *r, const poly *a, const poly *b);
+void poly_multiply(poly *r, const poly *a, const poly *b);
+void poly_pointwise_multiply(poly *r, const poly *a, const poly *b);
+void poly_shiftl(poly *r, const poly *a, unsigned k);
+void poly_power2round(poly *t1, poly *t0, const poly *t);
+void poly_reduce(poly *a);
+
+void poly_ntt(poly *a);
+void poly_invntt_tomont(poly *a);
+void poly_pointwise_montgomery(poly *c, const poly *a, const poly *b);
+void poly_ntt_x4(poly *const a[SHAKE_LANES]);
+void poly_invntt_tomont_x4(poly *const a[SHAKE_LANES]);
+
+void expand_matrix_a(poly A[K][L], const uint8_t *seed);
+void expand_matrix_entry_x4(poly *const a[SHAKE_LANES],
+                            const uint8_t *const seeds[SHAKE_LANES], int i, int j);
+void matrix_vector_multiply(polyveck *result, poly A[K][L], const polyvecl *s1);
+void sample_small_poly(poly *p, const uint8_t *seed, uint16_t nonce);
+void random_seed(uint8_t *seed);
+void secure_wipe(void *p, size_t len);
+
+// ============================================================================
+// PACKING AND KEY GENERATION
+// ============================================================================
+/*
+ * Every packed format here stores coefficients little-endian, `bits` bits
+ * each, so 8 coefficients always occupy exactly `bits` bytes. The block
+ * helpers work on one such group; with `bits` a compile-time constant they
+ * unroll into straight-line shifts with no per-byte loop.
+ */
+
+/* Pack 8 values of `bits` bits into `bits` bytes */
+static inline void pack_block8(uint8_t *r, const uint32_t a[8], unsigned bits) {
+    uint64_t acc = 0;
+    unsigned n = 0;
+
+    for (int i = 0; i < 8; i++) {
+        acc |= (uint64_t)a[i] << n;
+        n += bits;
+        while (n >= 8) {
+            *r++ = (uint8_t)acc;
+            acc >>= 8;
+            n -= 8;
+        }
+    }
+}
+
+/* Unpack 8 values of `bits` bits from `bits` bytes */
+static inline void unpack_block8(uint32_t a[8], const uint8_t *r, unsigned bits) {
+    uint32_t mask = (1u << bits) - 1;
+    uint64_t acc = 0;
+    unsigned n = 0;
+
+    for (int i = 0; i < 8; i++) {
+        while (n < bits) {
+            acc |= (uint64_t)*r++ << n;
+            n += 8;
+        }
+        a[i] = (uint32_t)acc & mask;
+        acc >>= bits;
+        n -= bits;
+    }
+}
+
+void polyt1_pack(uint8_t *r, const poly *a);
+void polyt1_unpack(poly *r, const uint8_t *a);
+void polyt0_pack(uint8_t *r, const poly *a);
+void polyt0_unpack(poly *r, const uint8_t *a);
+void polyeta_pack(uint8_t *r, const poly *a);
+void polyeta_unpack(poly *r, const uint8_t *a);
+void poly_power2round_pack(uint8_t *t1_bytes, uint8_t *t0_bytes, const poly *t);
+
+void pack_pk(uint8_t pk_bytes[PUBLICKEYBYTES], const public_key *pk);
+void unpack_pk(public_key *pk, const uint8_t pk_bytes[PUBLICKEYBYTES]);
+void pack_sk(uint8_t sk_bytes[SECRETKEYBYTES], const secret_key *sk);
+void unpack_sk(secret_key *sk, const uint8_t sk_bytes[SECRETKEYBYTES]);
+
+// Pairwise consistency test run after each keygen while set (NULL: off).
+// Dilithium_sign.c supplies one; see sign_set_keygen_pct.
+typedef int (*keygen_pct_fn)(const poly A[K][L], const public_key *pk,
+                             const secret_key *sk);
+void keygen_set_pct(keygen_pct_fn fn);
+
+void dilithium_keygen(public_key *pk, secret_key *sk);
+void dilithium_keygen_from_seed(public_key *pk, secret_key *sk,
+                                const uint8_t xi[SEEDBYTES]);
+void dilithium_keygen_rederive(public_key *pk, secret_key *sk, poly A[K][L],
+                               const uint8_t xi[SEEDBYTES]);
+void dilithium_keygen_packed(uint8_t pk_bytes[PUBLICKEYBYTES],
+                             uint8_t sk_bytes[SECRETKEYBYTES]);
+void dilithium_keygen_packed_from_seed(uint8_t pk_bytes[PUBLICKEYBYTES],
+                                       uint8_t sk_bytes[SECRETKEYBYTES],
+                                       const uint8_t xi[SEEDBYTES]);
+
+// ============================================================================
+// BENCHMARK HELPERS
+// ============================================================================
+double now_ns(void);
+uint64_t test_rand64(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * Dilithium Prepared Public Key Tool
+ * Turns packed public keys into prepared key files that verifiers mmap
+ * (see prepared_pk in Dilithium_sign.h) and inspects existing ones
+ *
+ * Build: gcc -O2 -pthread -DDILITHIUM_NO_MAIN -DDILITHIUM_NO_SIGN_MAIN \
+ *            -DSHAKE_NO_MAIN -o pk_tool \
+ *            Dilithium_pk_tool.c Dilithium_sign.c Dilithium_key_gen.c SHAKE.c
+ *
+ * Usage: pk_tool <packed.pk> <out.ppk> [<packed.pk> <out.ppk> ...]
+ *        pk_tool --check <file.ppk> [...]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "Dilithium_sign.h"
+
+// ============================================================================
+// COMMANDS
+// ============================================================================
+
+/* Packed public key (PUBLICKEYBYTES) -> prepared key file */
+static int convert(const char *in_path, const char *out_path) {
+    uint8_t pk_bytes[PUBLICKEYBYTES];
+    public_key pk;
+    FILE *f = fopen(in_path, "rb");
+    
+    if (!f) {
+        fprintf(stderr, "Could not open %s\n", in_path);
+        return -1;
+    }
+    size_t got = fread(pk_bytes, 1, PUBLICKEYBYTES, f);
+    int extra = fgetc(f) != EOF;
+    fclose(f);
+    if (got != PUBLICKEYBYTES || extra) {
+        fprintf(stderr, "%s: expected %d bytes of packed public key\n",
+                in_path, PUBLICKEYBYTES);
+        return -1;
+    }
+    
+    unpack_pk(&pk, pk_bytes);
+    if (prepared_pk_write(out_path, &pk) != 0) return -1;
+    
+    printf("%s -> %s (%zu bytes)\n", in_path, out_path, sizeof(prepared_pk));
+    return 0;
+}
+
+/* Map a prepared key file and print its header */
+static int check(const char *path) {
+    const prepared_pk *ppk = prepared_pk_map(path);
+    
+    if (!ppk) return -1;
+    
+    printf("%s: version %u, Q = %u, K = %u, L = %u, D = %u, rho = ", path,
+           ppk->hdr.version, ppk->hdr.q, ppk->hdr.params & 0xFF,
+           (ppk->hdr.params >> 8) & 0xFF, (ppk->hdr.params >> 16) & 0xFF);
+    for (int i = 0; i < 8; i++) {
+        printf("%02x", ppk->hdr.rho[i]);
+    }
+    printf("...\n");
+    
+    prepared_pk_unmap(ppk);
+    return 0;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char **argv) {
+    int failures = 0;
+    
+    if (argc >= 3 && strcmp(argv[1], "--check") == 0) {
+        for (int i = 2; i < argc; i++) {
+            failures += check(argv[i]) != 0;
+        }
+        return failures ? 1 : 0;
+    }
+    
+    if (argc < 3 || (argc - 1) % 2 != 0) {
+        fprintf(stderr, "Usage: %s <packed.pk> <out.ppk> [...]\n"
+                        "       %s --check <file.ppk> [...]\n", argv[0], argv[0]);
+        return 2;
+    }
+    
+    for (int i = 1; i + 1 < argc; i += 2) {
+        failures += convert(argv[i], argv[i + 1]) != 0;
+    }
+    return failures ? 1 : 0;
+}
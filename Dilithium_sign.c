@@ -0,0 +1,3222 @@
+/*
+ * Dilithium Signing - Educational Implementation
+ * Sign and verify on top of the key generation in Dilithium_key_gen.c
+ * This is a simplified version for learning purposes
+ * For production, use the official NIST PQC Dilithium library
+ *
+ * Build: gcc -O2 -pthread -DDILITHIUM_NO_MAIN -DSHAKE_NO_MAIN \
+ *            Dilithium_sign.c Dilithium_key_gen.c SHAKE.c
+ * (-DDILITHIUM_NO_SIGN_MAIN drops this demo as well)
+ */
+
+#define _GNU_SOURCE        // SCHED_IDLE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "Dilithium_sign.h"
+#include "SHAKE.h"
+
+#define CHAL_INBYTES (CRHBYTES + K * POLYW1_PACKEDBYTES)   // mu || w1
+
+// ============================================================================
+// ROUNDING AND NORMS
+// ============================================================================
+
+/* Centered representative of a in [0, Q): (-(Q-1)/2, (Q-1)/2] */
+static inline int32_t centered(int32_t a) {
+    return a - ((((Q - 1) / 2 - a) >> 31) & Q);
+}
+
+/* Split a in [0, Q) as a1 * 2*GAMMA2 + a0 with a0 centered; returns a1 */
+int32_t decompose(int32_t *a0, int32_t a) {
+    int32_t a1 = (a + 127) >> 7;
+    a1 = (a1 * 11275 + (1 << 23)) >> 24;
+    a1 ^= ((43 - a1) >> 31) & a1;     // a1 == 44 wraps to 0
+
+    *a0 = a - a1 * 2 * GAMMA2;
+    *a0 -= (((Q - 1) / 2 - *a0) >> 31) & Q;
+    return a1;
+}
+
+int32_t highbits(int32_t a) {
+    int32_t a0;
+    return decompose(&a0, a);
+}
+
+/* Recover HighBits(r + z) from r and the hint bit */
+int32_t use_hint(int32_t a, int hint) {
+    int32_t a0;
+    int32_t a1 = decompose(&a0, a);
+
+    if (!hint) return a1;
+    if (a0 > 0) return (a1 == 43) ? 0 : a1 + 1;
+    return (a1 == 0) ? 43 : a1 - 1;
+}
+
+/* 1 if any |coefficient| >= bound (coefficients in centered form) */
+int poly_chknorm(const poly *a, int32_t bound) {
+    for (int i = 0; i < N; i++) {
+        int32_t t = a->coeffs[i];
+        t = t - ((t >> 31) & 2 * t);   // |t|
+        if (t >= bound) return 1;
+    }
+    return 0;
+}
+
+// ============================================================================
+// SIGNATURE PACKING
+// ============================================================================
+// sig = c_tilde || z || h, with h as OMEGA hint indices + K running counts
+
+/*
+ * z: coefficients in (-GAMMA1, GAMMA1], stored as GAMMA1 - c. Like the
+ * unpacker below, four fields go out as one 64-bit word plus a byte; the
+ * byte stores of the word merge into a single store.
+ */
+void polyz_pack(uint8_t *r, const poly *a) {
+    for (int i = 0; i < N / 4; i++) {
+        uint8_t *p = r + 9 * i;
+        uint64_t t0 = (uint32_t)(GAMMA1 - a->coeffs[4 * i + 0]);
+        uint64_t t1 = (uint32_t)(GAMMA1 - a->coeffs[4 * i + 1]);
+        uint64_t t2 = (uint32_t)(GAMMA1 - a->coeffs[4 * i + 2]);
+        uint64_t t3 = (uint32_t)(GAMMA1 - a->coeffs[4 * i + 3]);
+        uint64_t lo = t0 | t1 << 18 | t2 << 36 | t3 << 54;
+
+        for (int b = 0; b < 8; b++) {
+            p[b] = (uint8_t)(lo >> (8 * b));
+        }
+        p[8] = (uint8_t)(t3 >> 10);
+    }
+}
+
+/*
+ * Four 18-bit fields fill exactly 9 bytes, so each group is one 64-bit
+ * little-endian word plus a trailing byte: no carry loop, no branches,
+ * and the final GAMMA1 - t runs over whole rows of coeffs where the
+ * compiler can vectorize it.
+ */
+void polyz_unpack(poly *r, const uint8_t *a) {
+    const uint32_t mask = (1u << 18) - 1;
+
+    for (int i = 0; i < N / 4; i++) {
+        const uint8_t *p = a + 9 * i;
+        uint64_t lo = 0;
+        for (int b = 0; b < 8; b++) {
+            lo |= (uint64_t)p[b] << (8 * b);
+        }
+        r->coeffs[4 * i + 0] = (int32_t)(lo & mask);
+        r->coeffs[4 * i + 1] = (int32_t)((lo >> 18) & mask);
+        r->coeffs[4 * i + 2] = (int32_t)((lo >> 36) & mask);
+        r->coeffs[4 * i + 3] = (int32_t)(((lo >> 54) | ((uint32_t)p[8] << 10)) & mask);
+    }
+    for (int i = 0; i < N; i++) {
+        r->coeffs[i] = GAMMA1 - r->coeffs[i];
+    }
+}
+
+/* w1: coefficients in [0, 44) */
+void polyw1_pack(uint8_t *r, const poly *a) {
+    for (int i = 0; i < N / 8; i++) {
+        pack_block8(r + 6 * i, (const uint32_t *)&a->coeffs[8 * i], 6);
+    }
+}
+
+/*
+ * Hint section, OMEGA + K bytes: the positions of the ones, row after row,
+ * then each row's running count. Rows are appended one at a time (k is
+ * the count so far) so a signer can emit them as it computes them.
+ * Returns the new count, or -1 once more than OMEGA ones have been seen.
+ */
+int polyh_pack(uint8_t *hint, int k, int row, const poly *h) {
+    uint8_t pos[N];
+    int n = 0;
+
+    // Branchless compaction: always store, advance only on a one
+    for (int j = 0; j < N; j++) {
+        pos[n] = (uint8_t)j;
+        n += h->coeffs[j] != 0;
+    }
+    if (k + n > OMEGA) return -1;
+    memcpy(hint + k, pos, n);
+    hint[OMEGA + row] = (uint8_t)(k + n);
+    return k + n;
+}
+
+/* Inverse of polyh_pack for one row; -1 for a malformed encoding */
+int polyh_unpack(poly *h, const uint8_t *hint, int k, int row) {
+    // Counts must be monotone and indices strictly increasing per poly
+    poly_zero(h);
+    if (hint[OMEGA + row] < k || hint[OMEGA + row] > OMEGA) return -1;
+    for (int j = k; j < hint[OMEGA + row]; j++) {
+        if (j > k && hint[j] <= hint[j - 1]) return -1;
+        h->coeffs[hint[j]] = 1;
+    }
+    return hint[OMEGA + row];
+}
+
+/* Returns -1, with the hint section incomplete, for more than OMEGA hints */
+int pack_sig(uint8_t sig[SIGBYTES], const uint8_t c_tilde[CTILDEBYTES],
+             const polyvecl *z, const polyveck *h) {
+    uint8_t *hint = sig + CTILDEBYTES + L * POLYZ_PACKEDBYTES;
+    int k = 0;
+
+    memcpy(sig, c_tilde, CTILDEBYTES);
+    for (int i = 0; i < L; i++) {
+        polyz_pack(sig + CTILDEBYTES + i * POLYZ_PACKEDBYTES, &z->vec[i]);
+    }
+    for (int i = 0; i < K; i++) {
+        k = polyh_pack(hint, k, i, &h->vec[i]);
+        if (k < 0) return -1;
+    }
+    memset(hint + k, 0, OMEGA - k);
+    return 0;
+}
+
+/* Returns -1 for a malformed hint encoding */
+int unpack_sig(uint8_t c_tilde[CTILDEBYTES], polyvecl *z, polyveck *h,
+               const uint8_t sig[SIGBYTES]) {
+    const uint8_t *hint = sig + CTILDEBYTES + L * POLYZ_PACKEDBYTES;
+    int k = 0;
+
+    memcpy(c_tilde, sig, CTILDEBYTES);
+    for (int i = 0; i < L; i++) {
+        polyz_unpack(&z->vec[i], sig + CTILDEBYTES + i * POLYZ_PACKEDBYTES);
+    }
+    for (int i = 0; i < K; i++) {
+        k = polyh_unpack(&h->vec[i], hint, k, i);
+        if (k < 0) return -1;
+    }
+    for (int j = k; j < OMEGA; j++) {
+        if (hint[j]) return -1;
+    }
+    return 0;
+}
+
+// ============================================================================
+// SAMPLING AND HASHING
+// ============================================================================
+
+/* tr = H(pk), the only key material the message digest needs */
+void compute_tr(uint8_t tr[TRBYTES], const public_key *pk) {
+    uint8_t pk_bytes[PUBLICKEYBYTES];
+
+    pack_pk(pk_bytes, pk);
+    shake256(tr, TRBYTES, pk_bytes, PUBLICKEYBYTES);
+}
+
+/*
+ * Streaming mu = H(tr || M). The context is a plain keccak_state, so the
+ * message can be fed in chunks as it arrives, on any thread or host that
+ * knows tr; only the 64-byte mu has to reach the signer.
+ */
+void mu_init(keccak_state *st, const uint8_t tr[TRBYTES]) {
+    shake_init(st, 256);
+    shake_absorb(st, tr, TRBYTES);
+}
+
+void mu_update(keccak_state *st, const uint8_t *chunk, size_t len) {
+    shake_absorb(st, chunk, len);
+}
+
+void mu_final(keccak_state *st, uint8_t mu[CRHBYTES]) {
+    shake_finalize(st);
+    shake_squeeze(st, mu, CRHBYTES);
+}
+
+/* mu = H(tr || M) for a message held in memory */
+void compute_mu(uint8_t mu[CRHBYTES], const uint8_t tr[TRBYTES],
+                const uint8_t *m, size_t mlen) {
+    keccak_state st;
+
+    mu_init(&st, tr);
+    mu_update(&st, m, mlen);
+    mu_final(&st, mu);
+}
+
+/*
+ * mu over a message given as segments (headers, payload, ...), absorbed
+ * in order straight from where they live - the same digest as
+ * compute_mu over their concatenation, without building it.
+ */
+void compute_mu_iov(uint8_t mu[CRHBYTES], const uint8_t tr[TRBYTES],
+                    const struct iovec *iov, int iovcnt) {
+    keccak_state st;
+
+    mu_init(&st, tr);
+    for (int i = 0; i < iovcnt; i++) {
+        mu_update(&st, iov[i].iov_base, iov[i].iov_len);
+    }
+    mu_final(&st, mu);
+}
+
+/* rho' = H(K || rnd || mu) */
+void compute_rhoprime(uint8_t rhoprime[CRHBYTES], const uint8_t key[SEEDBYTES],
+                      const uint8_t rnd[RNDBYTES], const uint8_t mu[CRHBYTES]) {
+    uint8_t in[SEEDBYTES + RNDBYTES + CRHBYTES];
+
+    memcpy(in, key, SEEDBYTES);
+    if (rnd) memcpy(in + SEEDBYTES, rnd, RNDBYTES);
+    else memset(in + SEEDBYTES, 0, RNDBYTES);
+    memcpy(in + SEEDBYTES + RNDBYTES, mu, CRHBYTES);
+    shake256(rhoprime, CRHBYTES, in, sizeof(in));
+}
+
+/*
+ * y[i] = ExpandMask(rho', L*nonce + i), coefficients in (-GAMMA1, GAMMA1].
+ * The L mask polys are independent SHAKE-256 streams of equal length, so
+ * they go SHAKE_LANES at a time through the four-way sponge (one squeeze
+ * for all of y when L == SHAKE_LANES). Spare lanes repeat the last poly.
+ */
+void expand_mask(polyvecl *y, const uint8_t rhoprime[CRHBYTES], uint16_t nonce) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    uint8_t *buf = arena_alloc(arena, SHAKE_LANES * POLYZ_PACKEDBYTES);
+    uint8_t in[SHAKE_LANES][CRHBYTES + 2];
+    const uint8_t *inputs[SHAKE_LANES];
+    uint8_t *outputs[SHAKE_LANES];
+
+    for (int i0 = 0; i0 < L; i0 += SHAKE_LANES) {
+        for (int j = 0; j < SHAKE_LANES; j++) {
+            int i = (i0 + j < L) ? i0 + j : L - 1;
+            uint16_t n = L * nonce + i;
+            memcpy(in[j], rhoprime, CRHBYTES);
+            in[j][CRHBYTES] = n & 0xFF;
+            in[j][CRHBYTES + 1] = n >> 8;
+            inputs[j] = in[j];
+            outputs[j] = buf + j * POLYZ_PACKEDBYTES;
+        }
+        shake256x4(outputs, POLYZ_PACKEDBYTES, inputs, CRHBYTES + 2);
+        for (int j = 0; j < SHAKE_LANES && i0 + j < L; j++) {
+            polyz_unpack(&y->vec[i0 + j], outputs[j]);
+        }
+    }
+
+    arena_restore(arena, mark);
+}
+
+/*
+ * Challenge c with TAU coefficients of +-1 (Fisher-Yates driven by
+ * SHAKE-256). After the 8 sign bytes, one 136-byte block holds enough
+ * index bytes for all TAU draws unless about 90 of them are rejected, so
+ * the loop reads bytes straight out of the sponge state and permutes only
+ * when a block runs dry - no per-byte squeeze call or bounds bookkeeping.
+ *
+ * cs (optional) receives the sparse form: the TAU nonzero positions in
+ * increasing order with their signs, ready for poly_mul_sparse.
+ */
+void sample_in_ball(poly *c, sparse_poly *cs, const uint8_t c_tilde[CTILDEBYTES]) {
+    keccak_state st;
+    const uint8_t *block = (const uint8_t *)st.state;
+    uint64_t signs = 0;
+    size_t pos = 8;
+
+    shake_init(&st, 256);
+    shake_absorb(&st, c_tilde, CTILDEBYTES);
+    shake_finalize(&st);
+
+    for (int i = 0; i < 8; i++) {
+        signs |= (uint64_t)block[i] << (8 * i);
+    }
+
+    poly_zero(c);
+    for (int i = N - TAU; i < N; i++) {
+        uint8_t b;
+        do {
+            if (pos == SHAKE256_RATE) {
+                keccak_f1600(st.state);
+                pos = 0;
+            }
+            b = block[pos++];
+        } while (b > i);
+
+        c->coeffs[i] = c->coeffs[b];
+        c->coeffs[b] = 1 - 2 * (int32_t)(signs & 1);
+        signs >>= 1;
+    }
+
+    if (cs) {
+        // Branchless compaction (the nonzero pattern is random); slot TAU
+        // absorbs the writes for trailing zeros
+        uint8_t index[TAU + 1];
+        int8_t sign[TAU + 1];
+        int k = 0;
+        for (int i = 0; i < N; i++) {
+            index[k] = i;
+            sign[k] = c->coeffs[i];
+            k += c->coeffs[i] != 0;
+        }
+        memcpy(cs->index, index, TAU);
+        memcpy(cs->sign, sign, TAU);
+    }
+}
+
+/*
+ * r = c*s for a sparse challenge: TAU signed, rotated copies of s
+ * (x^k * s wraps negacyclically). |s| < Q keeps the TAU-term sum far from
+ * int32 overflow, so one reduction per coefficient at the end suffices.
+ */
+void poly_mul_sparse(poly *r, const sparse_poly *c, const poly *s) {
+    int32_t acc[N] = { 0 };
+
+    for (int t = 0; t < TAU; t++) {
+        int k = c->index[t];
+        int32_t sign = c->sign[t];
+        for (int j = 0; j < N - k; j++) {
+            acc[j + k] += sign * s->coeffs[j];
+        }
+        for (int j = N - k; j < N; j++) {
+            acc[j + k - N] -= sign * s->coeffs[j];
+        }
+    }
+    for (int i = 0; i < N; i++) {
+        r->coeffs[i] = reduce_mod_q(acc[i]);
+    }
+}
+
+// ============================================================================
+// SIGNING
+// ============================================================================
+
+void prepare_sk(prepared_sk *psk, const secret_key *sk) {
+    memcpy(psk->rho, sk->seed, SEEDBYTES);
+    memcpy(psk->key, sk->key, SEEDBYTES);
+    memcpy(psk->tr, sk->tr, TRBYTES);
+    expand_matrix_a(psk->A, sk->seed);
+    psk->s1 = sk->s1;
+    psk->s2 = sk->s2;
+    psk->t0 = sk->t0;
+}
+
+/*
+ * What one attempt reads from the key, in either representation: plain
+ * polys multiplied by the sparse challenge (prepared_sk), or NTT forms
+ * multiplied pointwise (expanded_sk). Both give the same canonical
+ * products, so the signature does not depend on which key type is used.
+ */
+typedef struct {
+    const poly (*A)[L];        // A, or NTT(A) when ntt is set
+    const polyvecl *s1;
+    const polyveck *s2;
+    const polyveck *t0;
+    int ntt;
+    sk_view *view;             // Decode s1/s2/t0 from here on first use
+} signer;
+
+static const poly *signer_s1(const signer *key, int i) {
+    return key->view ? sk_view_s1_hat(key->view, i) : &key->s1->vec[i];
+}
+
+static const poly *signer_s2(const signer *key, int i) {
+    return key->view ? sk_view_s2_hat(key->view, i) : &key->s2->vec[i];
+}
+
+static const poly *signer_t0(const signer *key, int i) {
+    return key->view ? sk_view_t0_hat(key->view, i) : &key->t0->vec[i];
+}
+
+static signer signer_prepared(const prepared_sk *psk) {
+    signer s = { (const poly (*)[L])psk->A, &psk->s1, &psk->s2, &psk->t0, 0, NULL };
+    return s;
+}
+
+/* A_hat is esk->A_hat, or a caller-expanded NTT(A) when that is not cached */
+static signer signer_expanded(const expanded_sk *esk, const poly (*A_hat)[L]) {
+    signer s = { A_hat, &esk->s1_hat, &esk->s2_hat, &esk->t0_hat, 1, NULL };
+    return s;
+}
+
+/* r = c*s in [0, Q); with ntt set, c is NTT(c) and s an NTT form */
+static void challenge_mul(poly *r, const poly *c, const sparse_poly *cs,
+                          const poly *s, int ntt) {
+    if (!ntt) {
+        poly_mul_sparse(r, cs, s);
+        return;
+    }
+    poly_pointwise_montgomery(r, c, s);
+    poly_invntt_tomont(r);
+    poly_reduce(r);
+}
+
+/* w = A*y, with HighBits(w) packed into w1_bytes */
+static void sign_commit(polyveck *w, uint8_t *w1_bytes,
+                        const signer *key, const polyvecl *y) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    poly *w1 = arena_poly(arena);
+
+    if (key->ntt) {
+        polyvecl *y_hat = arena_polyvecl(arena);
+
+        *y_hat = *y;
+        for (int j = 0; j < L; j++) {
+            poly_ntt(&y_hat->vec[j]);
+        }
+        for (int i = 0; i < K; i++) {
+            poly *wi = &w->vec[i];
+            poly_pointwise_montgomery(wi, &key->A[i][0], &y_hat->vec[0]);
+            for (int j = 1; j < L; j++) {
+                poly_pointwise_montgomery(w1, &key->A[i][j], &y_hat->vec[j]);
+                for (int n = 0; n < N; n++) {
+                    wi->coeffs[n] += w1->coeffs[n];
+                }
+            }
+            poly_reduce(wi);
+            poly_invntt_tomont(wi);
+            poly_reduce(wi);
+        }
+    } else {
+        matrix_vector_multiply(w, (poly (*)[L])key->A, y);
+    }
+
+    for (int i = 0; i < K; i++) {
+        for (int j = 0; j < N; j++) {
+            w1->coeffs[j] = highbits(w->vec[i].coeffs[j]);
+        }
+        polyw1_pack(w1_bytes + i * POLYW1_PACKEDBYTES, w1);
+    }
+
+    arena_restore(arena, mark);
+}
+
+/*
+ * Rejection-loop statistics (sign_stats_enable). Counters are process-wide
+ * relaxed atomics, so batch and speculative workers can share them; when
+ * stats are off every hook is one untaken branch and nothing is timed.
+ */
+static atomic_int stats_on;
+
+static struct {
+    _Atomic uint64_t signatures;
+    _Atomic uint64_t attempts;
+    _Atomic uint64_t attempts_hist[SIGN_STATS_HIST];
+    _Atomic uint64_t rejects[SIGN_REJECT_KINDS];
+    _Atomic uint64_t stage_ns[SIGN_STAGES];
+    _Atomic uint64_t timed_attempts;
+    _Atomic uint64_t discarded;
+} stats;
+
+static inline int stats_enabled(void) {
+    return atomic_load_explicit(&stats_on, memory_order_relaxed);
+}
+
+static inline void stats_add(_Atomic uint64_t *counter, uint64_t v) {
+    atomic_fetch_add_explicit(counter, v, memory_order_relaxed);
+}
+
+static void stats_reject(int kind) {
+    if (stats_enabled()) stats_add(&stats.rejects[kind], 1);
+}
+
+/* One finished signature that took `attempts` attempts */
+static void stats_signature(unsigned attempts) {
+    if (!stats_enabled()) return;
+    stats_add(&stats.signatures, 1);
+    stats_add(&stats.attempts, attempts);
+    stats_add(&stats.attempts_hist[attempts < SIGN_STATS_HIST ? attempts - 1
+                                                              : SIGN_STATS_HIST - 1], 1);
+}
+
+void sign_stats_enable(int on) {
+    atomic_store(&stats_on, on);
+}
+
+void sign_stats_reset(void) {
+    atomic_store(&stats.signatures, 0);
+    atomic_store(&stats.attempts, 0);
+    atomic_store(&stats.timed_attempts, 0);
+    atomic_store(&stats.discarded, 0);
+    for (int i = 0; i < SIGN_STATS_HIST; i++) atomic_store(&stats.attempts_hist[i], 0);
+    for (int i = 0; i < SIGN_REJECT_KINDS; i++) atomic_store(&stats.rejects[i], 0);
+    for (int i = 0; i < SIGN_STAGES; i++) atomic_store(&stats.stage_ns[i], 0);
+}
+
+void sign_stats_get(sign_stats *out) {
+    out->signatures = atomic_load(&stats.signatures);
+    out->attempts = atomic_load(&stats.attempts);
+    out->timed_attempts = atomic_load(&stats.timed_attempts);
+    out->discarded = atomic_load(&stats.discarded);
+    for (int i = 0; i < SIGN_STATS_HIST; i++) out->attempts_hist[i] = atomic_load(&stats.attempts_hist[i]);
+    for (int i = 0; i < SIGN_REJECT_KINDS; i++) out->rejects[i] = atomic_load(&stats.rejects[i]);
+    for (int i = 0; i < SIGN_STAGES; i++) out->stage_ns[i] = atomic_load(&stats.stage_ns[i]);
+}
+
+/*
+ * Second half of an attempt: given the challenge seed, compute z, the low
+ * bits of w - c*s2, c*t0 and the hints, then apply the rejection checks.
+ * Returns 0 and writes sig when the attempt is accepted, -1 otherwise;
+ * sig doubles as output scratch, so a rejected attempt may leave it
+ * partly written.
+ *
+ * Two orderings accept exactly the same attempts. The eager one computes
+ * everything and checks at the end. The lazy one (default) checks in
+ * order of rejection probability per unit of work and returns at the
+ * first failing poly:
+ *
+ *     check                  needs              rejects
+ *     ||z|| < g1 - b         c*s1 (L products)  most attempts
+ *     ||r0|| < g2 - b        c*s2 (K products)  most of the rest
+ *     ||c*t0|| < g2, hints   c*t0 (K products)  rarely
+ *
+ * so a typical rejected attempt never touches s2 or t0.
+ */
+static int lazy_checks = 1;
+
+void sign_set_lazy_checks(int on) {
+    lazy_checks = on;
+}
+
+static int sign_respond_eager(uint8_t sig[SIGBYTES], const signer *key,
+                              const polyvecl *y, const polyveck *w,
+                              const uint8_t c_tilde[CTILDEBYTES]) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    poly *c = arena_poly(arena);
+    poly *tmp = arena_poly(arena);
+    sparse_poly cs;
+    polyvecl *z = arena_polyvecl(arena);
+    polyveck *wcs2 = arena_polyveck(arena);
+    polyveck *ct0 = arena_polyveck(arena);
+    polyveck *h = arena_polyveck(arena);
+    int r0_reject = 0, hints = 0;
+
+    sample_in_ball(c, &cs, c_tilde);
+    if (key->ntt) poly_ntt(c);
+
+    // z = y + c*s1
+    for (int i = 0; i < L; i++) {
+        challenge_mul(tmp, c, &cs, signer_s1(key, i), key->ntt);
+        for (int j = 0; j < N; j++) {
+            z->vec[i].coeffs[j] = centered(reduce_mod_q(
+                (int64_t)y->vec[i].coeffs[j] + tmp->coeffs[j]));
+        }
+    }
+
+    // w - c*s2 and its low bits r0
+    for (int i = 0; i < K; i++) {
+        challenge_mul(tmp, c, &cs, signer_s2(key, i), key->ntt);
+        poly_sub(&wcs2->vec[i], &w->vec[i], tmp);
+        for (int j = 0; j < N; j++) {
+            int32_t r0;
+            decompose(&r0, wcs2->vec[i].coeffs[j]);
+            r0_reject |= (r0 >= GAMMA2 - BETA) | (r0 <= -(GAMMA2 - BETA));
+        }
+    }
+
+    // c*t0 and the hints h = [HighBits(w - c*s2) != HighBits(w - c*s2 + c*t0)]
+    for (int i = 0; i < K; i++) {
+        challenge_mul(&ct0->vec[i], c, &cs, signer_t0(key, i), key->ntt);
+        for (int j = 0; j < N; j++) {
+            int32_t a = wcs2->vec[i].coeffs[j];
+            int32_t b = reduce_mod_q((int64_t)a + ct0->vec[i].coeffs[j]);
+            ct0->vec[i].coeffs[j] = centered(ct0->vec[i].coeffs[j]);
+            h->vec[i].coeffs[j] = highbits(a) != highbits(b);
+            hints += h->vec[i].coeffs[j];
+        }
+    }
+
+    // Rejection checks
+    int z_reject = 0, ct0_reject = 0;
+    for (int i = 0; i < L; i++) {
+        z_reject |= poly_chknorm(&z->vec[i], GAMMA1 - BETA);
+    }
+    for (int i = 0; i < K; i++) {
+        ct0_reject |= poly_chknorm(&ct0->vec[i], GAMMA2);
+    }
+    int reject = z_reject || r0_reject || ct0_reject || hints > OMEGA;
+
+    // pack_sig enforces the hint budget itself; a failure counts as hints
+    if (!reject) reject = pack_sig(sig, c_tilde, z, h) != 0;
+    if (reject) {
+        // Attributed in the lazy order so both modes report alike
+        stats_reject(z_reject ? SIGN_REJECT_Z : r0_reject ? SIGN_REJECT_R0
+                     : ct0_reject ? SIGN_REJECT_CT0 : SIGN_REJECT_HINTS);
+    }
+
+    arena_restore(arena, mark);
+    return reject ? -1 : 0;
+}
+
+static int sign_respond_lazy(uint8_t sig[SIGBYTES], const signer *key,
+                             const polyvecl *y, const polyveck *w,
+                             const uint8_t c_tilde[CTILDEBYTES]) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    poly *c = arena_poly(arena);
+    poly *tmp = arena_poly(arena);
+    sparse_poly cs;
+    polyveck *wcs2 = arena_polyveck(arena);
+    uint8_t *hint = sig + CTILDEBYTES + L * POLYZ_PACKEDBYTES;
+    int reject = 0, k = 0, kind = SIGN_REJECT_Z;
+
+    sample_in_ball(c, &cs, c_tilde);
+    if (key->ntt) poly_ntt(c);
+
+    // z = y + c*s1, checked one poly at a time and packed once it passes
+    for (int i = 0; i < L && !reject; i++) {
+        challenge_mul(tmp, c, &cs, signer_s1(key, i), key->ntt);
+        for (int j = 0; j < N; j++) {
+            tmp->coeffs[j] = centered(reduce_mod_q(
+                (int64_t)y->vec[i].coeffs[j] + tmp->coeffs[j]));
+        }
+        reject = poly_chknorm(tmp, GAMMA1 - BETA);
+        if (!reject) polyz_pack(sig + CTILDEBYTES + i * POLYZ_PACKEDBYTES, tmp);
+    }
+
+    // r0 = LowBits(w - c*s2)
+    if (!reject) kind = SIGN_REJECT_R0;
+    for (int i = 0; i < K && !reject; i++) {
+        challenge_mul(tmp, c, &cs, signer_s2(key, i), key->ntt);
+        poly_sub(&wcs2->vec[i], &w->vec[i], tmp);
+        for (int j = 0; j < N; j++) {
+            int32_t r0;
+            decompose(&r0, wcs2->vec[i].coeffs[j]);
+            reject |= (r0 >= GAMMA2 - BETA) | (r0 <= -(GAMMA2 - BETA));
+        }
+    }
+
+    // c*t0 bound, then hint positions written straight into the signature
+    for (int i = 0; i < K && !reject; i++) {
+        challenge_mul(tmp, c, &cs, signer_t0(key, i), key->ntt);
+        for (int j = 0; j < N; j++) {
+            tmp->coeffs[j] = centered(tmp->coeffs[j]);
+        }
+        kind = SIGN_REJECT_CT0;
+        reject = poly_chknorm(tmp, GAMMA2);
+
+        for (int j = 0; j < N && !reject; j++) {
+            int32_t a = wcs2->vec[i].coeffs[j];
+            int32_t b = reduce_mod_q((int64_t)a + tmp->coeffs[j]);
+            if (highbits(a) != highbits(b)) {
+                kind = SIGN_REJECT_HINTS;
+                reject = k == OMEGA;
+                if (!reject) hint[k++] = (uint8_t)j;
+            }
+        }
+        hint[OMEGA + i] = (uint8_t)k;
+    }
+
+    if (!reject) {
+        memcpy(sig, c_tilde, CTILDEBYTES);
+        memset(hint + k, 0, OMEGA - k);
+    } else {
+        stats_reject(kind);
+    }
+
+    arena_restore(arena, mark);
+    return reject ? -1 : 0;
+}
+
+static int sign_respond(uint8_t sig[SIGBYTES], const signer *key,
+                        const polyvecl *y, const polyveck *w,
+                        const uint8_t c_tilde[CTILDEBYTES]) {
+    if (lazy_checks) return sign_respond_lazy(sig, key, y, w, c_tilde);
+    return sign_respond_eager(sig, key, y, w, c_tilde);
+}
+
+/*
+ * One complete attempt with the given nonce. mu is the message digest and
+ * rhoprime the mask seed; returns 0 and writes sig if the attempt passes.
+ */
+static int sign_attempt(uint8_t sig[SIGBYTES], const signer *key,
+                        const uint8_t mu[CRHBYTES],
+                        const uint8_t rhoprime[CRHBYTES], uint16_t nonce) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    polyvecl *y = arena_polyvecl(arena);
+    polyveck *w = arena_polyveck(arena);
+    uint8_t chal_in[CHAL_INBYTES];     // mu || w1
+    uint8_t c_tilde[CTILDEBYTES];
+
+    int timed = stats_enabled();
+    double t[SIGN_STAGES + 1] = { 0 };
+
+    memcpy(chal_in, mu, CRHBYTES);
+    if (timed) t[0] = now_ns();
+    expand_mask(y, rhoprime, nonce);
+    if (timed) t[1] = now_ns();
+    sign_commit(w, chal_in + CRHBYTES, key, y);
+    if (timed) t[2] = now_ns();
+    shake256(c_tilde, CTILDEBYTES, chal_in, CHAL_INBYTES);
+    if (timed) t[3] = now_ns();
+    int ret = sign_respond(sig, key, y, w, c_tilde);
+
+    if (timed) {
+        t[4] = now_ns();
+        for (int i = 0; i < SIGN_STAGES; i++) {
+            stats_add(&stats.stage_ns[i], (uint64_t)(t[i + 1] - t[i]));
+        }
+        stats_add(&stats.timed_attempts, 1);
+    }
+
+    arena_restore(arena, mark);
+    return ret;
+}
+
+/* Sign a precomputed mu (see mu_init); the message itself is never seen */
+int sign_mu(uint8_t sig[SIGBYTES], const uint8_t mu[CRHBYTES],
+            const prepared_sk *psk, const uint8_t rnd[RNDBYTES]) {
+    signer key = signer_prepared(psk);
+    uint8_t rhoprime[CRHBYTES];
+
+    compute_rhoprime(rhoprime, psk->key, rnd, mu);
+
+    for (uint16_t nonce = 0; ; nonce++) {
+        if (sign_attempt(sig, &key, mu, rhoprime, nonce) == 0) {
+            stats_signature(nonce + 1u);
+            break;
+        }
+    }
+    return 0;
+}
+
+int sign_prepared(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+                  const prepared_sk *psk, const uint8_t rnd[RNDBYTES]) {
+    uint8_t mu[CRHBYTES];
+
+    compute_mu(mu, psk->tr, m, mlen);
+    return sign_mu(sig, mu, psk, rnd);
+}
+
+int dilithium_sign(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+                   const secret_key *sk, const uint8_t rnd[RNDBYTES]) {
+    prepared_sk *psk = aligned_alloc(ARENA_ALIGN, sizeof(prepared_sk));
+    if (!psk) return -1;
+
+    prepare_sk(psk, sk);
+    sign_prepared(sig, m, mlen, psk, rnd);
+
+    secure_wipe(psk, sizeof(*psk));
+    free(psk);
+    return 0;
+}
+
+int dilithium_sign_iov(uint8_t sig[SIGBYTES], const struct iovec *iov,
+                       int iovcnt, const secret_key *sk,
+                       const uint8_t rnd[RNDBYTES]) {
+    prepared_sk *psk = aligned_alloc(ARENA_ALIGN, sizeof(prepared_sk));
+    uint8_t mu[CRHBYTES];
+    if (!psk) return -1;
+
+    prepare_sk(psk, sk);
+    compute_mu_iov(mu, psk->tr, iov, iovcnt);
+    sign_mu(sig, mu, psk, rnd);
+
+    secure_wipe(psk, sizeof(*psk));
+    free(psk);
+    return 0;
+}
+
+// ============================================================================
+// EXPANDED SECRET KEY
+// ============================================================================
+
+/* Struct size rounded up so a cached NTT(A) starts on a cache line */
+#define EXPANDED_HEAD_BYTES \
+    ((sizeof(expanded_sk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/* Bytes one expanded key occupies (the per-key memory footprint) */
+size_t expanded_sk_bytes(int cache_a) {
+    return EXPANDED_HEAD_BYTES + (cache_a ? sizeof(poly[K][L]) : 0);
+}
+
+/* NTT of every entry of A = ExpandA(rho) */
+static void expand_matrix_a_ntt(poly A_hat[K][L], const uint8_t *rho) {
+    expand_matrix_a(A_hat, rho);
+    for (int i = 0; i < K; i++) {
+        for (int j = 0; j < L; j++) {
+            poly_ntt(&A_hat[i][j]);
+        }
+    }
+}
+
+/* Fill esk from sk; NTT(A) comes from A when given, else from ExpandA */
+static void expanded_sk_fill(expanded_sk *esk, const secret_key *sk, int cache_a,
+                             const poly A[K][L]) {
+    esk->s1_hat = sk->s1;
+    esk->s2_hat = sk->s2;
+    esk->t0_hat = sk->t0;
+    for (int i = 0; i < L; i++) poly_ntt(&esk->s1_hat.vec[i]);
+    for (int i = 0; i < K; i++) poly_ntt(&esk->s2_hat.vec[i]);
+    for (int i = 0; i < K; i++) poly_ntt(&esk->t0_hat.vec[i]);
+
+    esk->A_hat = NULL;
+    if (cache_a) {
+        esk->A_hat = (poly (*)[L])((uint8_t *)esk + EXPANDED_HEAD_BYTES);
+        if (A) {
+            memcpy(esk->A_hat, A, sizeof(poly[K][L]));
+            for (int i = 0; i < K; i++) {
+                for (int j = 0; j < L; j++) {
+                    poly_ntt(&esk->A_hat[i][j]);
+                }
+            }
+        } else {
+            expand_matrix_a_ntt(esk->A_hat, sk->seed);
+        }
+    }
+
+    memcpy(esk->rho, sk->seed, SEEDBYTES);
+    memcpy(esk->key, sk->key, SEEDBYTES);
+    memcpy(esk->tr, sk->tr, TRBYTES);
+}
+
+expanded_sk *expanded_sk_new(const secret_key *sk, int cache_a) {
+    expanded_sk *esk = aligned_alloc(ARENA_ALIGN, expanded_sk_bytes(cache_a));
+    if (!esk) return NULL;
+
+    expanded_sk_fill(esk, sk, cache_a, NULL);
+    return esk;
+}
+
+void expanded_sk_free(expanded_sk *esk) {
+    if (!esk) return;
+    secure_wipe(esk, expanded_sk_bytes(esk->A_hat != NULL));
+    free(esk);
+}
+
+int sign_expanded_mu(uint8_t sig[SIGBYTES], const uint8_t mu[CRHBYTES],
+                     const expanded_sk *esk, const uint8_t rnd[RNDBYTES]) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    poly (*A_hat)[L] = esk->A_hat;
+    uint8_t rhoprime[CRHBYTES];
+
+    if (!A_hat) {
+        A_hat = arena_alloc(arena, sizeof(poly[K][L]));
+        expand_matrix_a_ntt(A_hat, esk->rho);
+    }
+
+    signer key = signer_expanded(esk, (const poly (*)[L])A_hat);
+
+    compute_rhoprime(rhoprime, esk->key, rnd, mu);
+    for (uint16_t nonce = 0; ; nonce++) {
+        if (sign_attempt(sig, &key, mu, rhoprime, nonce) == 0) {
+            stats_signature(nonce + 1u);
+            break;
+        }
+    }
+
+    arena_restore(arena, mark);
+    return 0;
+}
+
+int sign_expanded(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+                  const expanded_sk *esk, const uint8_t rnd[RNDBYTES]) {
+    uint8_t mu[CRHBYTES];
+
+    compute_mu(mu, esk->tr, m, mlen);
+    return sign_expanded_mu(sig, mu, esk, rnd);
+}
+
+int sign_expanded_iov(uint8_t sig[SIGBYTES], const struct iovec *iov,
+                      int iovcnt, const expanded_sk *esk,
+                      const uint8_t rnd[RNDBYTES]) {
+    uint8_t mu[CRHBYTES];
+
+    compute_mu_iov(mu, esk->tr, iov, iovcnt);
+    return sign_expanded_mu(sig, mu, esk, rnd);
+}
+
+// ============================================================================
+// LAZY SECRET-KEY VIEW
+// ============================================================================
+/*
+ * Signing straight from the packed key. rho, K and tr are read in place;
+ * each s1/s2/t0 poly is decoded the first time an attempt multiplies by
+ * it, unpacked into its slot and transformed there, so no plain-domain
+ * copy of the key exists. A rejected attempt stops decoding where the
+ * lazy checks stop (see sign_respond_lazy), and a view kept across
+ * requests decodes each poly once. Not safe to share between threads
+ * while polys are still being decoded.
+ */
+#define SKV_S1_OFFSET (2 * SEEDBYTES + TRBYTES)
+#define SKV_S2_OFFSET (SKV_S1_OFFSET + L * POLYETA_PACKEDBYTES)
+#define SKV_T0_OFFSET (SKV_S2_OFFSET + K * POLYETA_PACKEDBYTES)
+
+void sk_view_init(sk_view *v, const uint8_t sk_bytes[SECRETKEYBYTES]) {
+    v->bytes = sk_bytes;
+    v->ready = 0;
+}
+
+/* Wipe the decoded NTT forms; the view must be re-initialized before use */
+void sk_view_clear(sk_view *v) {
+    secure_wipe(v, sizeof(*v));
+}
+
+const uint8_t *sk_view_rho(const sk_view *v) { return v->bytes; }
+const uint8_t *sk_view_key(const sk_view *v) { return v->bytes + SEEDBYTES; }
+const uint8_t *sk_view_tr(const sk_view *v) { return v->bytes + 2 * SEEDBYTES; }
+
+const poly *sk_view_s1_hat(sk_view *v, int i) {
+    poly *p = &v->s1_hat.vec[i];
+    if (!(v->ready & 1u << i)) {
+        polyeta_unpack(p, v->bytes + SKV_S1_OFFSET + i * POLYETA_PACKEDBYTES);
+        poly_ntt(p);
+        v->ready |= 1u << i;
+    }
+    return p;
+}
+
+const poly *sk_view_s2_hat(sk_view *v, int i) {
+    poly *p = &v->s2_hat.vec[i];
+    if (!(v->ready & 1u << (L + i))) {
+        polyeta_unpack(p, v->bytes + SKV_S2_OFFSET + i * POLYETA_PACKEDBYTES);
+        poly_ntt(p);
+        v->ready |= 1u << (L + i);
+    }
+    return p;
+}
+
+const poly *sk_view_t0_hat(sk_view *v, int i) {
+    poly *p = &v->t0_hat.vec[i];
+    if (!(v->ready & 1u << (L + K + i))) {
+        polyt0_unpack(p, v->bytes + SKV_T0_OFFSET + i * POLYT0_PACKEDBYTES);
+        poly_ntt(p);
+        v->ready |= 1u << (L + K + i);
+    }
+    return p;
+}
+
+int sign_view_mu(uint8_t sig[SIGBYTES], const uint8_t mu[CRHBYTES],
+                 sk_view *v, const uint8_t rnd[RNDBYTES]) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    poly (*A_hat)[L] = arena_alloc(arena, sizeof(poly[K][L]));
+    uint8_t rhoprime[CRHBYTES];
+
+    expand_matrix_a_ntt(A_hat, sk_view_rho(v));
+    signer key = { (const poly (*)[L])A_hat, &v->s1_hat, &v->s2_hat,
+                   &v->t0_hat, 1, v };
+
+    compute_rhoprime(rhoprime, sk_view_key(v), rnd, mu);
+    for (uint16_t nonce = 0; ; nonce++) {
+        if (sign_attempt(sig, &key, mu, rhoprime, nonce) == 0) {
+            stats_signature(nonce + 1u);
+            break;
+        }
+    }
+
+    arena_restore(arena, mark);
+    return 0;
+}
+
+int sign_view(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+              sk_view *v, const uint8_t rnd[RNDBYTES]) {
+    uint8_t mu[CRHBYTES];
+
+    compute_mu(mu, sk_view_tr(v), m, mlen);
+    return sign_view_mu(sig, mu, v, rnd);
+}
+
+// ============================================================================
+// SEED-ONLY SECRET KEYS
+// ============================================================================
+/*
+ * A seed_sk is the 32-byte master seed (everything else is derived from
+ * it by dilithium_keygen_from_seed) plus a slot for its expanded form.
+ * The cache decides how many expansions stay resident: cold keys cost 48
+ * bytes, hot ones an expanded_sk each. Eviction scans the resident list,
+ * which is cheap next to the keygen + NTTs a miss pays. A cache and its
+ * handles are not locked; share them across threads only under a lock.
+ */
+void seed_sk_init(seed_sk *ssk, const uint8_t xi[SEEDBYTES]) {
+    memcpy(ssk->xi, xi, SEEDBYTES);
+    ssk->esk = NULL;
+    ssk->last_use = 0;
+}
+
+int seed_sk_cache_init(seed_sk_cache *c, int policy, size_t capacity, int cache_a) {
+    c->policy = policy;
+    c->cache_a = cache_a;
+    c->capacity = policy == SEED_CACHE_NONE ? 0 : capacity;
+    c->count = 0;
+    c->clock = 0;
+    c->resident = NULL;
+    if (c->capacity) {
+        c->resident = malloc(c->capacity * sizeof(seed_sk *));
+        if (!c->resident) return -1;
+    }
+    return 0;
+}
+
+void seed_sk_cache_free(seed_sk_cache *c) {
+    for (size_t i = 0; i < c->count; i++) {
+        expanded_sk_free(c->resident[i]->esk);
+        c->resident[i]->esk = NULL;
+    }
+    free(c->resident);
+    c->resident = NULL;
+    c->count = 0;
+}
+
+/* Drop a handle's expansion, e.g. before the handle itself is freed */
+void seed_sk_evict(seed_sk_cache *c, seed_sk *ssk) {
+    for (size_t i = 0; i < c->count; i++) {
+        if (c->resident[i] == ssk) {
+            c->resident[i] = c->resident[--c->count];
+            break;
+        }
+    }
+    expanded_sk_free(ssk->esk);
+    ssk->esk = NULL;
+}
+
+/*
+ * Regenerate the full key from xi and expand it. The key passed its PCT
+ * when it was first generated, so re-derivation skips it, and NTT(A)
+ * comes from the A keygen expands anyway.
+ */
+static expanded_sk *seed_sk_expand(const uint8_t xi[SEEDBYTES], int cache_a) {
+    struct { public_key pk; secret_key sk; poly A[K][L]; } *keys;
+    keys = malloc(sizeof(*keys));
+    expanded_sk *esk = aligned_alloc(ARENA_ALIGN, expanded_sk_bytes(cache_a));
+
+    if (keys && esk) {
+        dilithium_keygen_rederive(&keys->pk, &keys->sk, keys->A, xi);
+        expanded_sk_fill(esk, &keys->sk, cache_a, (const poly (*)[L])keys->A);
+        secure_wipe(&keys->sk, sizeof(keys->sk));
+    } else {
+        free(esk);
+        esk = NULL;
+    }
+    free(keys);
+    return esk;
+}
+
+/* The handle's expanded key, building it (and evicting the LRU entry) on a miss */
+static expanded_sk *seed_sk_acquire(seed_sk_cache *c, seed_sk *ssk) {
+    ssk->last_use = ++c->clock;
+    if (ssk->esk) return ssk->esk;
+
+    expanded_sk *esk = seed_sk_expand(ssk->xi, c->cache_a);
+    if (!esk || c->capacity == 0) return esk;
+
+    if (c->count == c->capacity) {
+        size_t victim = 0;
+        for (size_t i = 1; i < c->count; i++) {
+            if (c->resident[i]->last_use < c->resident[victim]->last_use) victim = i;
+        }
+        seed_sk_evict(c, c->resident[victim]);
+    }
+    c->resident[c->count++] = ssk;
+    ssk->esk = esk;
+    return esk;
+}
+
+int sign_seed_sk(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+                 seed_sk *ssk, seed_sk_cache *c, const uint8_t rnd[RNDBYTES]) {
+    expanded_sk *esk = seed_sk_acquire(c, ssk);
+    if (!esk) return -1;
+
+    sign_expanded(sig, m, mlen, esk, rnd);
+    if (!ssk->esk) expanded_sk_free(esk);
+    return 0;
+}
+
+// ============================================================================
+// SPECULATIVE SIGNING
+// ============================================================================
+/*
+ * The number of attempts is geometric (about 4 on average for these
+ * parameters, occasionally 15 or more), which is what puts the long tail
+ * on signing latency. Speculative mode runs `width` consecutive nonces as
+ * one fork_join round and keeps the lowest nonce that was accepted. Every
+ * nonce below it was tried and rejected, exactly as the sequential loop
+ * would have done, so the signature is identical to sign_prepared's.
+ *
+ * The extra attempts only pay off with latency mode on: without worker
+ * threads a round just runs its attempts one after another.
+ */
+
+#define SPEC_MAX_WIDTH 8      // Candidates live in the caller's scratch arena
+
+typedef struct {
+    signer key;
+    const uint8_t *mu;
+    const uint8_t *rhoprime;
+    uint16_t base;                  // Nonce of attempt 0 in this round
+    uint8_t (*sigs)[SIGBYTES];      // One candidate per attempt
+    int accepted[SPEC_MAX_WIDTH];
+} spec_round;
+
+static void spec_task(void *arg, int index) {
+    spec_round *round = arg;
+
+    round->accepted[index] = sign_attempt(round->sigs[index], &round->key,
+                                          round->mu, round->rhoprime,
+                                          round->base + index) == 0;
+}
+
+/* width <= 0 uses one attempt per latency-mode thread */
+int sign_speculative(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+                     const prepared_sk *psk, const uint8_t rnd[RNDBYTES],
+                     int width) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    uint8_t mu[CRHBYTES];
+    uint8_t rhoprime[CRHBYTES];
+    spec_round round;
+
+    if (width <= 0) width = latency_mode_threads();
+    if (width > SPEC_MAX_WIDTH) width = SPEC_MAX_WIDTH;
+
+    compute_mu(mu, psk->tr, m, mlen);
+    compute_rhoprime(rhoprime, psk->key, rnd, mu);
+
+    round.key = signer_prepared(psk);
+    round.mu = mu;
+    round.rhoprime = rhoprime;
+    round.sigs = arena_alloc(arena, (size_t)width * SIGBYTES);
+
+    for (round.base = 0; ; round.base += width) {
+        fork_join(spec_task, &round, width);
+
+        int winner = -1;
+        for (int i = 0; i < width && winner < 0; i++) {
+            if (round.accepted[i]) winner = i;
+        }
+        if (winner >= 0) {
+            memcpy(sig, round.sigs[winner], SIGBYTES);
+            // The signature took the nonces up to the winner, as the
+            // sequential loop would; the rest of the round ran for nothing
+            stats_signature(round.base + (unsigned)winner + 1);
+            if (stats_enabled()) stats_add(&stats.discarded, (uint64_t)(width - winner - 1));
+            break;
+        }
+    }
+
+    arena_restore(arena, mark);
+    return 0;
+}
+
+// ============================================================================
+// OFFLINE/ONLINE SIGNING (COMMITMENT POOL)
+// ============================================================================
+/*
+ * y, w = A*y and w1 are the expensive half of an attempt (ExpandMask plus
+ * the K*L matrix products) and none of them look at the message. A pool
+ * keeps a bounded ring of these triples per key. One worker thread, run
+ * under SCHED_IDLE so it only gets cycles nobody else wants, tops the ring
+ * up whenever an entry is taken.
+ *
+ * Masks come from rho' = H(K || rnd) with fresh rnd and a nonce that is
+ * claimed under the lock, so no y is ever generated twice; an entry is
+ * copied out and wiped from the ring when taken and wiped again after its
+ * one attempt, accepted or not. A signer that finds the ring empty builds
+ * the commitment inline instead of waiting for the worker.
+ */
+
+#define POOL_NONCES (65536 / L)   // expand_mask's 16-bit counter space per rho'
+
+typedef struct {
+    polyvecl y;
+    polyveck w;
+    uint8_t w1[K * POLYW1_PACKEDBYTES];
+} commit_entry;
+
+struct commit_pool {
+    const prepared_sk *psk;
+    signer key;                   // Attempt view of psk
+    commit_entry *ring;           // capacity slots, oldest ready one at head
+    size_t capacity;
+    size_t head;
+    size_t count;                 // Ready entries
+    uint8_t rhoprime[CRHBYTES];   // Mask seed for the current nonce range
+    uint32_t nonce;               // Next unclaimed nonce under rhoprime
+    size_t hits, misses;          // Attempts served from the ring / inline
+    pthread_mutex_t lock;
+    pthread_cond_t wake;          // Worker: an entry was taken, or stop
+    pthread_cond_t full;          // commit_pool_fill: ring is full
+    pthread_t worker;
+    int stop;
+};
+
+/* Claim an unused (rho', nonce) pair; the caller holds the lock */
+static void pool_claim(commit_pool *pool, uint8_t rhoprime[CRHBYTES],
+                       uint16_t *nonce) {
+    if (pool->nonce == POOL_NONCES) {
+        uint8_t in[SEEDBYTES + RNDBYTES];
+
+        memcpy(in, pool->psk->key, SEEDBYTES);
+        random_seed(in + SEEDBYTES);          // RNDBYTES == SEEDBYTES
+        shake256(pool->rhoprime, CRHBYTES, in, sizeof(in));
+        secure_wipe(in, sizeof(in));
+        pool->nonce = 0;
+    }
+    memcpy(rhoprime, pool->rhoprime, CRHBYTES);
+    *nonce = (uint16_t)pool->nonce++;
+}
+
+/* The offline half of an attempt for a claimed nonce */
+static void pool_generate(commit_entry *e, const signer *key,
+                          const uint8_t rhoprime[CRHBYTES], uint16_t nonce) {
+    expand_mask(&e->y, rhoprime, nonce);
+    sign_commit(&e->w, e->w1, key, &e->y);
+}
+
+static void *pool_worker(void *arg) {
+    commit_pool *pool = arg;
+    struct sched_param idle = { 0 };
+    uint8_t rhoprime[CRHBYTES];
+    uint16_t nonce;
+
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &idle);
+    fork_join_run_inline();
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stop) {
+        if (pool->count == pool->capacity) {
+            pthread_cond_broadcast(&pool->full);
+            pthread_cond_wait(&pool->wake, &pool->lock);
+            continue;
+        }
+        // The tail slot is not visible to takers until count covers it
+        commit_entry *e = &pool->ring[(pool->head + pool->count) % pool->capacity];
+        pool_claim(pool, rhoprime, &nonce);
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_generate(e, &pool->key, rhoprime, nonce);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->count++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    secure_wipe(rhoprime, sizeof(rhoprime));
+    return NULL;
+}
+
+/* Start a pool of `capacity` entries; the worker begins filling at once */
+commit_pool *commit_pool_new(const prepared_sk *psk, size_t capacity) {
+    commit_pool *pool;
+
+    if (capacity == 0) return NULL;
+    pool = calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+
+    // sizeof(commit_entry) is a multiple of ARENA_ALIGN
+    pool->ring = aligned_alloc(ARENA_ALIGN, capacity * sizeof(commit_entry));
+    if (!pool->ring) {
+        free(pool);
+        return NULL;
+    }
+    pool->psk = psk;
+    pool->key = signer_prepared(psk);
+    pool->capacity = capacity;
+    pool->nonce = POOL_NONCES;        // First claim draws rho'
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->full, NULL);
+
+    if (pthread_create(&pool->worker, NULL, pool_worker, pool) != 0) {
+        fprintf(stderr, "Could not start the commitment pool worker\n");
+        pthread_cond_destroy(&pool->full);
+        pthread_cond_destroy(&pool->wake);
+        pthread_mutex_destroy(&pool->lock);
+        free(pool->ring);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/* Stop the worker and wipe every unused entry */
+void commit_pool_free(commit_pool *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    pthread_join(pool->worker, NULL);
+
+    secure_wipe(pool->ring, pool->capacity * sizeof(commit_entry));
+    secure_wipe(pool->rhoprime, CRHBYTES);
+    pthread_cond_destroy(&pool->full);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->ring);
+    free(pool);
+}
+
+/* Block until the worker has filled the ring, e.g. ahead of a burst */
+void commit_pool_fill(commit_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count < pool->capacity) {
+        pthread_cond_signal(&pool->wake);
+        pthread_cond_wait(&pool->full, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Ready entries right now */
+size_t commit_pool_level(commit_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    size_t count = pool->count;
+    pthread_mutex_unlock(&pool->lock);
+    return count;
+}
+
+void commit_pool_stats(commit_pool *pool, size_t *hits, size_t *misses) {
+    pthread_mutex_lock(&pool->lock);
+    if (hits) *hits = pool->hits;
+    if (misses) *misses = pool->misses;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Move the oldest ready entry into e, or claim a nonce to build one inline */
+static void pool_take(commit_pool *pool, commit_entry *e) {
+    uint8_t rhoprime[CRHBYTES];
+    uint16_t nonce;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count > 0) {
+        commit_entry *slot = &pool->ring[pool->head];
+
+        memcpy(e, slot, sizeof(*e));
+        memset(slot, 0, sizeof(*slot));
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pool->hits++;
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    pool_claim(pool, rhoprime, &nonce);
+    pool->misses++;
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_generate(e, &pool->key, rhoprime, nonce);
+    secure_wipe(rhoprime, sizeof(rhoprime));
+}
+
+/* Online signing: every attempt draws a fresh entry from the pool */
+int sign_pooled(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+                commit_pool *pool) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    commit_entry *e = arena_alloc(arena, sizeof(commit_entry));
+    uint8_t chal_in[CHAL_INBYTES];     // mu || w1
+    uint8_t c_tilde[CTILDEBYTES];
+    unsigned attempts = 0;
+    int ret;
+
+    compute_mu(chal_in, pool->psk->tr, m, mlen);
+    do {
+        pool_take(pool, e);
+        attempts++;
+        memcpy(chal_in + CRHBYTES, e->w1, K * POLYW1_PACKEDBYTES);
+        shake256(c_tilde, CTILDEBYTES, chal_in, CHAL_INBYTES);
+        ret = sign_respond(sig, &pool->key, &e->y, &e->w, c_tilde);
+        secure_wipe(e, sizeof(*e));     // y must never sign twice
+    } while (ret != 0);
+    stats_signature(attempts);
+
+    arena_restore(arena, mark);
+    return 0;
+}
+
+// ============================================================================
+// BATCH SIGNING
+// ============================================================================
+/*
+ * The key-dependent work (NTT(A), NTT(s1/s2/t0), tr) is done once into an
+ * expanded_sk that every message shares read-only. Messages are then
+ * signed in groups of SHAKE_LANES: the group runs its rejection loops in
+ * lockstep so that rho', ExpandMask and the challenge hash of all lanes go
+ * through one four-way Keccak call each. Lanes that already accepted keep
+ * riding along (their hash output is ignored) until the whole group is
+ * done. Groups are independent tasks for fork_join, so latency mode spreads
+ * them across the worker threads.
+ */
+
+typedef struct {
+    const expanded_sk *esk;
+    signer key;
+    const uint8_t *const *msgs;
+    const size_t *mlens;
+    uint8_t (*sigs)[SIGBYTES];
+    size_t count;
+    const uint8_t (*rnds)[RNDBYTES];
+} batch_job;
+
+static void batch_task(void *arg, int group) {
+    batch_job *job = arg;
+    const expanded_sk *esk = job->esk;
+    const signer *key = &job->key;
+    size_t first = (size_t)group * SHAKE_LANES;
+    size_t lanes = job->count - first < SHAKE_LANES ? job->count - first
+                                                    : SHAKE_LANES;
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    polyvecl *y = arena_alloc(arena, SHAKE_LANES * sizeof(polyvecl));
+    polyveck *w = arena_alloc(arena, SHAKE_LANES * sizeof(polyveck));
+    uint8_t chal_in[SHAKE_LANES][CHAL_INBYTES];
+    uint8_t seed_in[SHAKE_LANES][SEEDBYTES + RNDBYTES + CRHBYTES];
+    uint8_t mask_in[SHAKE_LANES][CRHBYTES + 2];
+    uint8_t mask_out[SHAKE_LANES][POLYZ_PACKEDBYTES];
+    uint8_t c_tilde[SHAKE_LANES][CTILDEBYTES];
+    uint16_t nonce[SHAKE_LANES] = { 0 };
+    int done[SHAKE_LANES];
+    const uint8_t *in[SHAKE_LANES];
+    uint8_t *out[SHAKE_LANES];
+    size_t pending = lanes;
+
+    // mu per message (lengths differ, so this part is scalar)
+    for (size_t j = 0; j < SHAKE_LANES; j++) {
+        done[j] = j >= lanes;
+        if (done[j]) {
+            memset(chal_in[j], 0, CRHBYTES);
+        } else {
+            compute_mu(chal_in[j], esk->tr, job->msgs[first + j],
+                       job->mlens[first + j]);
+        }
+    }
+
+    // rho' = H(K || rnd || mu) for all lanes at once
+    for (size_t j = 0; j < SHAKE_LANES; j++) {
+        memcpy(seed_in[j], esk->key, SEEDBYTES);
+        if (job->rnds && !done[j]) {
+            memcpy(seed_in[j] + SEEDBYTES, job->rnds[first + j], RNDBYTES);
+        } else {
+            memset(seed_in[j] + SEEDBYTES, 0, RNDBYTES);
+        }
+        memcpy(seed_in[j] + SEEDBYTES + RNDBYTES, chal_in[j], CRHBYTES);
+        in[j] = seed_in[j];
+        out[j] = mask_in[j];
+    }
+    shake256x4(out, CRHBYTES, in, SEEDBYTES + RNDBYTES + CRHBYTES);
+
+    while (pending > 1) {
+        // ExpandMask: poly i of every lane in one four-way call
+        for (int i = 0; i < L; i++) {
+            for (size_t j = 0; j < SHAKE_LANES; j++) {
+                uint16_t n = L * nonce[j] + i;
+                mask_in[j][CRHBYTES] = n & 0xFF;
+                mask_in[j][CRHBYTES + 1] = n >> 8;
+                in[j] = mask_in[j];
+                out[j] = mask_out[j];
+            }
+            shake256x4(out, POLYZ_PACKEDBYTES, in, CRHBYTES + 2);
+            for (size_t j = 0; j < SHAKE_LANES; j++) {
+                if (!done[j]) polyz_unpack(&y[j].vec[i], mask_out[j]);
+            }
+        }
+
+        for (size_t j = 0; j < SHAKE_LANES; j++) {
+            if (!done[j]) sign_commit(&w[j], chal_in[j] + CRHBYTES, key, &y[j]);
+            in[j] = chal_in[j];
+            out[j] = c_tilde[j];
+        }
+        shake256x4(out, CTILDEBYTES, in, CHAL_INBYTES);
+
+        for (size_t j = 0; j < SHAKE_LANES; j++) {
+            if (done[j]) continue;
+            if (sign_respond(job->sigs[first + j], key, &y[j], &w[j],
+                             c_tilde[j]) == 0) {
+                stats_signature(nonce[j] + 1u);
+                done[j] = 1;
+                pending--;
+            } else {
+                nonce[j]++;
+            }
+        }
+    }
+
+    // A lone straggler gains nothing from four-way hashing; finish it alone
+    for (size_t j = 0; j < SHAKE_LANES && pending > 0; j++) {
+        if (done[j]) continue;
+        while (sign_attempt(job->sigs[first + j], key, chal_in[j], mask_in[j],
+                            nonce[j]) != 0) {
+            nonce[j]++;
+        }
+        stats_signature(nonce[j] + 1u);
+        pending--;
+    }
+
+    arena_restore(arena, mark);
+}
+
+int sign_batch(const secret_key *sk, const uint8_t *const msgs[],
+               const size_t mlens[], uint8_t (*sigs)[SIGBYTES],
+               size_t count, const uint8_t (*rnds)[RNDBYTES]) {
+    expanded_sk *esk = expanded_sk_new(sk, 1);
+    if (!esk) return -1;
+
+    batch_job job = { esk, signer_expanded(esk, (const poly (*)[L])esk->A_hat),
+                      msgs, mlens, sigs, count, rnds };
+    fork_join(batch_task, &job, (int)((count + SHAKE_LANES - 1) / SHAKE_LANES));
+
+    expanded_sk_free(esk);
+    return 0;
+}
+
+// ============================================================================
+// VERIFICATION
+// ============================================================================
+
+/* polyz_unpack with the |z| < GAMMA1 - BETA bound checked group by group */
+static int polyz_unpack_checked(poly *r, const uint8_t *a) {
+    const uint32_t mask = (1u << 18) - 1;
+    // |GAMMA1 - t| < GAMMA1 - BETA  <=>  t - (BETA + 1) < span (unsigned)
+    const uint32_t low = BETA + 1, span = 2 * (GAMMA1 - BETA) - 1;
+
+    for (int i = 0; i < N / 4; i++) {
+        const uint8_t *p = a + 9 * i;
+        uint64_t lo = 0;
+        for (int b = 0; b < 8; b++) {
+            lo |= (uint64_t)p[b] << (8 * b);
+        }
+        uint32_t t0 = lo & mask;
+        uint32_t t1 = (lo >> 18) & mask;
+        uint32_t t2 = (lo >> 36) & mask;
+        uint32_t t3 = ((lo >> 54) | ((uint32_t)p[8] << 10)) & mask;
+
+        if ((t0 - low >= span) | (t1 - low >= span) |
+            (t2 - low >= span) | (t3 - low >= span)) {
+            return -1;
+        }
+        r->coeffs[4 * i + 0] = GAMMA1 - (int32_t)t0;
+        r->coeffs[4 * i + 1] = GAMMA1 - (int32_t)t1;
+        r->coeffs[4 * i + 2] = GAMMA1 - (int32_t)t2;
+        r->coeffs[4 * i + 3] = GAMMA1 - (int32_t)t3;
+    }
+    return 0;
+}
+
+/*
+ * Verifier front end: decode and range-check a packed signature in one
+ * pass, cheapest rejection first - the length, then the OMEGA + K hint
+ * bytes at the tail, then z with its bound applied while unpacking.
+ * Nothing here hashes or multiplies, so a flood of malformed signatures
+ * costs little more than reading them. Returns -1 on the first problem.
+ */
+int sig_decode(uint8_t c_tilde[CTILDEBYTES], polyvecl *z, polyveck *h,
+               const uint8_t *sig, size_t siglen) {
+    const uint8_t *hint = sig + CTILDEBYTES + L * POLYZ_PACKEDBYTES;
+
+    if (siglen != SIGBYTES) return -1;
+
+    // Counts must be monotone and indices strictly increasing per poly
+    int k = 0;
+    for (int i = 0; i < K; i++) {
+        if (hint[OMEGA + i] < k || hint[OMEGA + i] > OMEGA) return -1;
+        for (int j = k + 1; j < hint[OMEGA + i]; j++) {
+            if (hint[j] <= hint[j - 1]) return -1;
+        }
+        k = hint[OMEGA + i];
+    }
+    for (int j = k; j < OMEGA; j++) {
+        if (hint[j]) return -1;
+    }
+
+    for (int i = 0; i < L; i++) {
+        if (polyz_unpack_checked(&z->vec[i],
+                                 sig + CTILDEBYTES + i * POLYZ_PACKEDBYTES)) {
+            return -1;
+        }
+    }
+
+    memcpy(c_tilde, sig, CTILDEBYTES);
+    k = 0;
+    for (int i = 0; i < K; i++) {
+        poly_zero(&h->vec[i]);
+        for (; k < hint[OMEGA + i]; k++) {
+            h->vec[i].coeffs[hint[k]] = 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * The expensive half of verification, for a decoded, in-range signature:
+ * w1 = UseHint(h, A*z - c*t1*2^D) in the NTT domain, then the challenge
+ * is recomputed and compared. z is transformed in place.
+ */
+static int verify_core(const uint8_t c_tilde[CTILDEBYTES], polyvecl *z,
+                       const polyveck *h, const uint8_t mu[CRHBYTES],
+                       const poly A_hat[K][L], const polyveck *t1_hat) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    poly *w = arena_poly(arena);
+    poly *tmp = arena_poly(arena);
+    poly *c = arena_poly(arena);
+    uint8_t chal_in[CHAL_INBYTES];
+    uint8_t c_check[CTILDEBYTES];
+
+    memcpy(chal_in, mu, CRHBYTES);
+    sample_in_ball(c, NULL, c_tilde);
+    poly_ntt(c);
+    for (int j = 0; j < L; j++) {
+        poly_ntt(&z->vec[j]);
+    }
+
+    for (int i = 0; i < K; i++) {
+        poly_pointwise_montgomery(w, c, &t1_hat->vec[i]);
+        for (int n = 0; n < N; n++) w->coeffs[n] = -w->coeffs[n];
+        for (int j = 0; j < L; j++) {
+            poly_pointwise_montgomery(tmp, &A_hat[i][j], &z->vec[j]);
+            for (int n = 0; n < N; n++) w->coeffs[n] += tmp->coeffs[n];
+        }
+        poly_reduce(w);
+        poly_invntt_tomont(w);
+        poly_reduce(w);
+        for (int n = 0; n < N; n++) {
+            w->coeffs[n] = use_hint(w->coeffs[n], h->vec[i].coeffs[n]);
+        }
+        polyw1_pack(chal_in + CRHBYTES + i * POLYW1_PACKEDBYTES, w);
+    }
+
+    shake256(c_check, CTILDEBYTES, chal_in, CHAL_INBYTES);
+
+    arena_restore(arena, mark);
+    return memcmp(c_tilde, c_check, CTILDEBYTES) ? -1 : 0;
+}
+
+/* NTT(A) and NTT(t1 * 2^D): the key-dependent part of verification */
+static void pk_expand_ntt(poly A_hat[K][L], polyveck *t1_hat,
+                          const public_key *pk) {
+    expand_matrix_a_ntt(A_hat, pk->seed);
+    for (int i = 0; i < K; i++) {
+        poly_shiftl(&t1_hat->vec[i], &pk->t1.vec[i], D);
+        poly_ntt(&t1_hat->vec[i]);
+    }
+}
+
+static int verify_decoded(const uint8_t c_tilde[CTILDEBYTES], polyvecl *z,
+                          const polyveck *h, const uint8_t mu[CRHBYTES],
+                          const public_key *pk) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    poly (*A_hat)[L] = arena_alloc(arena, sizeof(poly[K][L]));
+    polyveck *t1_hat = arena_polyveck(arena);
+
+    pk_expand_ntt(A_hat, t1_hat, pk);
+    int ret = verify_core(c_tilde, z, h, mu, (const poly (*)[L])A_hat, t1_hat);
+
+    arena_restore(arena, mark);
+    return ret;
+}
+
+int dilithium_verify_mu(const uint8_t sig[SIGBYTES], const uint8_t mu[CRHBYTES],
+                        const public_key *pk) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    polyvecl *z = arena_polyvecl(arena);
+    polyveck *h = arena_polyveck(arena);
+    uint8_t c_tilde[CTILDEBYTES];
+    int ret = -1;
+
+    if (sig_decode(c_tilde, z, h, sig, SIGBYTES) == 0) {
+        ret = verify_decoded(c_tilde, z, h, mu, pk);
+    }
+
+    arena_restore(arena, mark);
+    return ret;
+}
+
+/* Verify a signature of any claimed length; it is decoded before tr and mu */
+int dilithium_verify_iov(const uint8_t *sig, size_t siglen,
+                         const struct iovec *iov, int iovcnt,
+                         const public_key *pk) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    polyvecl *z = arena_polyvecl(arena);
+    polyveck *h = arena_polyveck(arena);
+    uint8_t c_tilde[CTILDEBYTES];
+    uint8_t tr[TRBYTES];
+    uint8_t mu[CRHBYTES];
+    int ret = -1;
+
+    if (sig_decode(c_tilde, z, h, sig, siglen) == 0) {
+        compute_tr(tr, pk);
+        compute_mu_iov(mu, tr, iov, iovcnt);
+        ret = verify_decoded(c_tilde, z, h, mu, pk);
+    }
+
+    arena_restore(arena, mark);
+    return ret;
+}
+
+int dilithium_verify_len(const uint8_t *sig, size_t siglen, const uint8_t *m,
+                         size_t mlen, const public_key *pk) {
+    struct iovec seg = { (void *)m, mlen };
+    return dilithium_verify_iov(sig, siglen, &seg, 1, pk);
+}
+
+int dilithium_verify(const uint8_t sig[SIGBYTES], const uint8_t *m,
+                     size_t mlen, const public_key *pk) {
+    return dilithium_verify_len(sig, SIGBYTES, m, mlen, pk);
+}
+
+// ============================================================================
+// KEYGEN PAIRWISE CONSISTENCY TEST
+// ============================================================================
+/*
+ * Sign a fixed message with the new key and verify it. Starting from the
+ * keygen's A, the test transforms it once and both halves share that
+ * NTT(A), so ExpandA - the bulk of a naive sign + verify from packed
+ * keys - never runs; tr comes from sk rather than rehashing pk.
+ */
+static const uint8_t pct_msg[] = "pairwise consistency test";
+
+int dilithium_pct(const poly A[K][L], const public_key *pk, const secret_key *sk) {
+    expanded_sk *esk = aligned_alloc(ARENA_ALIGN, expanded_sk_bytes(1));
+    uint8_t sig[SIGBYTES], mu[CRHBYTES], c_tilde[CTILDEBYTES];
+    int ret = -1;
+
+    if (!esk) return -1;
+    expanded_sk_fill(esk, sk, 1, A);
+    compute_mu(mu, sk->tr, pct_msg, sizeof(pct_msg));
+    sign_expanded_mu(sig, mu, esk, NULL);
+
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    polyvecl *z = arena_polyvecl(arena);
+    polyveck *h = arena_polyveck(arena);
+    polyveck *t1_hat = arena_polyveck(arena);
+
+    for (int i = 0; i < K; i++) {
+        poly_shiftl(&t1_hat->vec[i], &pk->t1.vec[i], D);
+        poly_ntt(&t1_hat->vec[i]);
+    }
+    if (sig_decode(c_tilde, z, h, sig, SIGBYTES) == 0) {
+        ret = verify_core(c_tilde, z, h, mu, (const poly (*)[L])esk->A_hat, t1_hat);
+    }
+
+    arena_restore(arena, mark);
+    expanded_sk_free(esk);
+    return ret;
+}
+
+void sign_set_keygen_pct(int on) {
+    keygen_set_pct(on ? dilithium_pct : NULL);
+}
+
+// ============================================================================
+// PREPARED PUBLIC KEYS
+// ============================================================================
+/*
+ * A prepared_pk is both the in-memory and the on-disk form, so a file
+ * written by prepared_pk_write can be mmap'd and handed to
+ * verify_prepared with no parsing or copying. prepared_pk_check only
+ * validates the header: magic, version, the writer's endian tag (files
+ * are stored in host byte order and refused on a foreign-endian host),
+ * the parameter set and the size.
+ */
+
+_Static_assert(sizeof(prepared_pk_header) == 64, "header must be one cache line");
+_Static_assert(offsetof(prepared_pk, A_hat) % ARENA_ALIGN == 0, "A_hat alignment");
+_Static_assert(offsetof(prepared_pk, t1_hat) % ARENA_ALIGN == 0, "t1_hat alignment");
+
+void prepare_pk(prepared_pk *ppk, const public_key *pk) {
+    memset(&ppk->hdr, 0, sizeof(ppk->hdr));
+    memcpy(ppk->hdr.magic, PREPARED_PK_MAGIC, sizeof(ppk->hdr.magic));
+    ppk->hdr.version = PREPARED_PK_VERSION;
+    ppk->hdr.endian = PREPARED_PK_ENDIAN;
+    ppk->hdr.q = Q;
+    ppk->hdr.params = K | (L << 8) | (D << 16);
+    ppk->hdr.bytes = sizeof(prepared_pk);
+    memcpy(ppk->hdr.rho, pk->seed, SEEDBYTES);
+
+    compute_tr(ppk->tr, pk);
+    pk_expand_ntt(ppk->A_hat, &ppk->t1_hat, pk);
+}
+
+const prepared_pk *prepared_pk_check(const void *buf, size_t len) {
+    const prepared_pk *ppk = buf;
+
+    if (len < sizeof(prepared_pk) || ((uintptr_t)buf % ARENA_ALIGN) != 0) {
+        return NULL;
+    }
+    if (memcmp(ppk->hdr.magic, PREPARED_PK_MAGIC, sizeof(ppk->hdr.magic)) != 0 ||
+        ppk->hdr.version != PREPARED_PK_VERSION ||
+        ppk->hdr.endian != PREPARED_PK_ENDIAN ||
+        ppk->hdr.q != Q ||
+        ppk->hdr.params != (uint32_t)(K | (L << 8) | (D << 16)) ||
+        ppk->hdr.bytes != sizeof(prepared_pk)) {
+        return NULL;
+    }
+    return ppk;
+}
+
+int verify_prepared_mu(const uint8_t *sig, size_t siglen,
+                       const uint8_t mu[CRHBYTES], const prepared_pk *ppk) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    polyvecl *z = arena_polyvecl(arena);
+    polyveck *h = arena_polyveck(arena);
+    uint8_t c_tilde[CTILDEBYTES];
+    int ret = -1;
+
+    if (sig_decode(c_tilde, z, h, sig, siglen) == 0) {
+        ret = verify_core(c_tilde, z, h, mu, ppk->A_hat, &ppk->t1_hat);
+    }
+
+    arena_restore(arena, mark);
+    return ret;
+}
+
+/* As dilithium_verify_iov: a malformed signature is rejected before mu */
+int verify_prepared_iov(const uint8_t *sig, size_t siglen,
+                        const struct iovec *iov, int iovcnt,
+                        const prepared_pk *ppk) {
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    polyvecl *z = arena_polyvecl(arena);
+    polyveck *h = arena_polyveck(arena);
+    uint8_t c_tilde[CTILDEBYTES];
+    uint8_t mu[CRHBYTES];
+    int ret = -1;
+
+    if (sig_decode(c_tilde, z, h, sig, siglen) == 0) {
+        compute_mu_iov(mu, ppk->tr, iov, iovcnt);
+        ret = verify_core(c_tilde, z, h, mu, ppk->A_hat, &ppk->t1_hat);
+    }
+
+    arena_restore(arena, mark);
+    return ret;
+}
+
+int verify_prepared(const uint8_t *sig, size_t siglen, const uint8_t *m,
+                    size_t mlen, const prepared_pk *ppk) {
+    struct iovec seg = { (void *)m, mlen };
+    return verify_prepared_iov(sig, siglen, &seg, 1, ppk);
+}
+
+int prepared_pk_write(const char *path, const public_key *pk) {
+    prepared_pk *ppk = aligned_alloc(ARENA_ALIGN, sizeof(prepared_pk));
+    FILE *f;
+    int ret = -1;
+
+    if (!ppk) return -1;
+    prepare_pk(ppk, pk);
+
+    f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+    } else {
+        if (fwrite(ppk, sizeof(prepared_pk), 1, f) == 1) ret = 0;
+        if (fclose(f) != 0) ret = -1;
+        if (ret) fprintf(stderr, "Could not write %s\n", path);
+    }
+
+    free(ppk);
+    return ret;
+}
+
+const prepared_pk *prepared_pk_map(const char *path) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    void *map;
+
+    if (fd < 0) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != sizeof(prepared_pk)) {
+        fprintf(stderr, "%s is not a prepared key file\n", path);
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, sizeof(prepared_pk), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Could not map %s\n", path);
+        return NULL;
+    }
+
+    const prepared_pk *ppk = prepared_pk_check(map, sizeof(prepared_pk));
+    if (!ppk) {
+        fprintf(stderr, "%s: bad header (version, byte order or parameters)\n", path);
+        munmap(map, sizeof(prepared_pk));
+    }
+    return ppk;
+}
+
+void prepared_pk_unmap(const prepared_pk *ppk) {
+    if (ppk) munmap((void *)ppk, sizeof(prepared_pk));
+}
+
+// ============================================================================
+// STREAMING SIGN AND VERIFY
+// ============================================================================
+/*
+ * For data passing through a proxy: the context is the mu sponge part-way
+ * through absorbing M plus a reference to the key (an expanded_sk on the
+ * signing side, a prepared_pk on the verifying side), which must outlive
+ * it. Chunks go straight into Keccak, so memory stays constant
+ * and an update costs what absorbing its bytes costs. A context is
+ * finished by its final call; start the next message with a fresh init.
+ */
+void sign_init(sign_ctx *ctx, const expanded_sk *esk) {
+    ctx->esk = esk;
+    mu_init(&ctx->st, esk->tr);
+}
+
+void sign_update(sign_ctx *ctx, const uint8_t *chunk, size_t len) {
+    mu_update(&ctx->st, chunk, len);
+}
+
+int sign_final(sign_ctx *ctx, uint8_t sig[SIGBYTES],
+               const uint8_t rnd[RNDBYTES]) {
+    uint8_t mu[CRHBYTES];
+
+    mu_final(&ctx->st, mu);
+    return sign_expanded_mu(sig, mu, ctx->esk, rnd);
+}
+
+void verify_init(verify_ctx *ctx, const prepared_pk *ppk) {
+    ctx->ppk = ppk;
+    mu_init(&ctx->st, ppk->tr);
+}
+
+void verify_update(verify_ctx *ctx, const uint8_t *chunk, size_t len) {
+    mu_update(&ctx->st, chunk, len);
+}
+
+int verify_final(verify_ctx *ctx, const uint8_t *sig, size_t siglen) {
+    uint8_t mu[CRHBYTES];
+
+    mu_final(&ctx->st, mu);
+    return verify_prepared_mu(sig, siglen, mu, ctx->ppk);
+}
+
+// ============================================================================
+// BATCH VERIFICATION
+// ============================================================================
+/*
+ * Items are verified SHAKE_LANES at a time, each lane with its own public
+ * key. The public-key hashes for tr, every ExpandA entry and the final
+ * challenge hashes run through the four-way sponge, and the NTTs of A, z,
+ * c and t1 (and the inverse NTT of w) run in the lane-interleaved form.
+ * A is streamed one row at a time, so a group never holds four full
+ * matrices. A lane that fails to parse is masked and still rides along,
+ * so one bad signature costs its group nothing extra. Groups are
+ * fork_join tasks.
+ */
+
+typedef struct {
+    const verify_item *items;
+    int *results;
+    size_t count;
+} verify_job;
+
+/* Hint bits of row i from an already validated signature */
+static void hint_row(poly *h, const uint8_t sig[SIGBYTES], int i) {
+    const uint8_t *hint = sig + CTILDEBYTES + L * POLYZ_PACKEDBYTES;
+    int from = (i == 0) ? 0 : hint[OMEGA + i - 1];
+
+    poly_zero(h);
+    for (int k = from; k < hint[OMEGA + i]; k++) {
+        h->coeffs[hint[k]] = 1;
+    }
+}
+
+static void verify_task(void *arg, int group) {
+    verify_job *job = arg;
+    size_t first = (size_t)group * SHAKE_LANES;
+    size_t lanes = job->count - first < SHAKE_LANES ? job->count - first
+                                                    : SHAKE_LANES;
+    poly_arena *arena = scratch_arena();
+    arena_mark mark = arena_save(arena);
+    polyvecl *z = arena_alloc(arena, SHAKE_LANES * sizeof(polyvecl));
+    poly (*A_row)[L] = arena_alloc(arena, SHAKE_LANES * sizeof(poly[L]));
+    poly *c = arena_alloc(arena, SHAKE_LANES * sizeof(poly));
+    poly *t1 = arena_alloc(arena, SHAKE_LANES * sizeof(poly));
+    poly *w = arena_alloc(arena, SHAKE_LANES * sizeof(poly));
+    poly *tmp = arena_poly(arena);
+    polyveck *h = arena_polyveck(arena);
+    const verify_item *item[SHAKE_LANES];
+    uint8_t pk_bytes[SHAKE_LANES][PUBLICKEYBYTES];
+    uint8_t tr[SHAKE_LANES][TRBYTES];
+    uint8_t chal_in[SHAKE_LANES][CHAL_INBYTES];
+    uint8_t c_tilde[SHAKE_LANES][CTILDEBYTES];
+    uint8_t c_check[SHAKE_LANES][CTILDEBYTES];
+    const uint8_t *in[SHAKE_LANES], *seeds[SHAKE_LANES];
+    uint8_t *out[SHAKE_LANES];
+    poly *lane[SHAKE_LANES];
+    int ok[SHAKE_LANES];
+
+    // Decode and range-check; spare lanes repeat the first item
+    for (size_t j = 0; j < SHAKE_LANES; j++) {
+        item[j] = &job->items[first + (j < lanes ? j : 0)];
+        ok[j] = j < lanes &&
+                sig_decode(c_tilde[j], &z[j], h, item[j]->sig, SIGBYTES) == 0;
+        if (!ok[j]) {
+            memset(&z[j], 0, sizeof(polyvecl));
+            memset(c_tilde[j], 0, CTILDEBYTES);
+        }
+        pack_pk(pk_bytes[j], item[j]->pk);
+        in[j] = pk_bytes[j];
+        out[j] = tr[j];
+        seeds[j] = item[j]->pk->seed;
+    }
+
+    // tr = H(pk) for all lanes, then mu per message
+    shake256x4(out, TRBYTES, in, PUBLICKEYBYTES);
+    for (size_t j = 0; j < SHAKE_LANES; j++) {
+        compute_mu(chal_in[j], tr[j], item[j]->m, item[j]->mlen);
+        sample_in_ball(&c[j], NULL, c_tilde[j]);
+        lane[j] = &c[j];
+    }
+    poly_ntt_x4(lane);
+    for (int l = 0; l < L; l++) {
+        for (size_t j = 0; j < SHAKE_LANES; j++) lane[j] = &z[j].vec[l];
+        poly_ntt_x4(lane);
+    }
+
+    // w' = A*z - c*t1*2^D one row at a time, then w1 = UseHint(h, w')
+    for (int i = 0; i < K; i++) {
+        for (int l = 0; l < L; l++) {
+            for (size_t j = 0; j < SHAKE_LANES; j++) lane[j] = &A_row[j][l];
+            expand_matrix_entry_x4(lane, seeds, i, l);
+            poly_ntt_x4(lane);
+        }
+        for (size_t j = 0; j < SHAKE_LANES; j++) {
+            poly_shiftl(&t1[j], &item[j]->pk->t1.vec[i], D);
+            lane[j] = &t1[j];
+        }
+        poly_ntt_x4(lane);
+
+        for (size_t j = 0; j < SHAKE_LANES; j++) {
+            poly_pointwise_montgomery(&w[j], &c[j], &t1[j]);
+            for (int n = 0; n < N; n++) w[j].coeffs[n] = -w[j].coeffs[n];
+            for (int l = 0; l < L; l++) {
+                poly_pointwise_montgomery(tmp, &A_row[j][l], &z[j].vec[l]);
+                for (int n = 0; n < N; n++) w[j].coeffs[n] += tmp->coeffs[n];
+            }
+            poly_reduce(&w[j]);
+            lane[j] = &w[j];
+        }
+        poly_invntt_tomont_x4(lane);
+
+        for (size_t j = 0; j < SHAKE_LANES; j++) {
+            poly_reduce(&w[j]);
+            if (ok[j]) hint_row(tmp, item[j]->sig, i);
+            else poly_zero(tmp);
+            for (int n = 0; n < N; n++) {
+                w[j].coeffs[n] = use_hint(w[j].coeffs[n], tmp->coeffs[n]);
+            }
+            polyw1_pack(chal_in[j] + CRHBYTES + i * POLYW1_PACKEDBYTES, &w[j]);
+        }
+    }
+
+    for (size_t j = 0; j < SHAKE_LANES; j++) {
+        in[j] = chal_in[j];
+        out[j] = c_check[j];
+    }
+    shake256x4(out, CTILDEBYTES, in, CHAL_INBYTES);
+
+    for (size_t j = 0; j < lanes; j++) {
+        job->results[first + j] =
+            ok[j] && memcmp(c_tilde[j], c_check[j], CTILDEBYTES) == 0 ? 0 : -1;
+    }
+
+    arena_restore(arena, mark);
+}
+
+int verify_batch(const verify_item *items, int results[], size_t count) {
+    verify_job job = { items, results, count };
+
+    fork_join(verify_task, &job, (int)((count + SHAKE_LANES - 1) / SHAKE_LANES));
+
+    for (size_t i = 0; i < count; i++) {
+        if (results[i] != 0) return -1;
+    }
+    return 0;
+}
+
+// ============================================================================
+// VERIFICATION CACHE
+// ============================================================================
+/*
+ * Remembers triples that verified, keyed by SHAKE-256(tr || sig || M):
+ * tr binds the public key and sig has a fixed length, so the encoding is
+ * unambiguous. Only successes are stored, so a stream of bad signatures
+ * cannot push good entries out, and a hit means a full 256-bit match.
+ *
+ * The table is VCACHE_WAYS-way set-associative with a per-entry sequence
+ * counter. Readers never wait: they read the counter, the key words and
+ * the counter again, and treat an odd or changed value as a miss. A
+ * writer claims an entry by moving its counter from even to odd with a
+ * CAS and gives up (skips the insert) if another writer holds it.
+ */
+#define VCACHE_WAYS 4
+#define VCACHE_WORDS 4             // 256-bit key as 64-bit words
+
+typedef struct {
+    _Atomic uint64_t seq;      // Odd while a writer owns the entry
+    _Atomic uint64_t key[VCACHE_WORDS];
+} vcache_entry;
+
+struct verify_cache {
+    vcache_entry *entries;     // sets * VCACHE_WAYS, ARENA_ALIGN aligned
+    size_t set_mask;
+    _Atomic uint64_t hits;
+    _Atomic uint64_t misses;
+    _Atomic uint64_t inserts;
+};
+
+verify_cache *verify_cache_new(size_t entries) {
+    size_t sets = 1;
+    while (sets * VCACHE_WAYS < entries) sets <<= 1;
+
+    verify_cache *vc = malloc(sizeof(verify_cache));
+    if (!vc) return NULL;
+    size_t bytes = sets * VCACHE_WAYS * sizeof(vcache_entry);
+    vc->entries = aligned_alloc(ARENA_ALIGN, (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1));
+    if (!vc->entries) {
+        free(vc);
+        return NULL;
+    }
+    // Zeroed memory is a valid empty table (no live key is all zero)
+    memset(vc->entries, 0, bytes);
+    vc->set_mask = sets - 1;
+    atomic_init(&vc->hits, 0);
+    atomic_init(&vc->misses, 0);
+    atomic_init(&vc->inserts, 0);
+    return vc;
+}
+
+void verify_cache_free(verify_cache *vc) {
+    if (!vc) return;
+    free(vc->entries);
+    free(vc);
+}
+
+void verify_cache_stats(const verify_cache *vc, uint64_t *hits,
+                        uint64_t *misses, uint64_t *inserts) {
+    *hits = atomic_load_explicit(&vc->hits, memory_order_relaxed);
+    *misses = atomic_load_explicit(&vc->misses, memory_order_relaxed);
+    *inserts = atomic_load_explicit(&vc->inserts, memory_order_relaxed);
+}
+
+static void vcache_key(uint64_t key[VCACHE_WORDS], const uint8_t tr[TRBYTES],
+                       const uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen) {
+    keccak_state st;
+    uint8_t digest[8 * VCACHE_WORDS];
+
+    shake_init(&st, 256);
+    shake_absorb(&st, tr, TRBYTES);
+    shake_absorb(&st, sig, SIGBYTES);
+    shake_absorb(&st, m, mlen);
+    shake_finalize(&st);
+    shake_squeeze(&st, digest, sizeof(digest));
+    for (int w = 0; w < VCACHE_WORDS; w++) {
+        key[w] = 0;
+        for (int b = 0; b < 8; b++) {
+            key[w] |= (uint64_t)digest[8 * w + b] << (8 * b);
+        }
+    }
+}
+
+static vcache_entry *vcache_set(verify_cache *vc, const uint64_t key[VCACHE_WORDS]) {
+    return vc->entries + (key[0] & vc->set_mask) * VCACHE_WAYS;
+}
+
+static int vcache_lookup(verify_cache *vc, const uint64_t key[VCACHE_WORDS]) {
+    vcache_entry *set = vcache_set(vc, key);
+
+    for (int way = 0; way < VCACHE_WAYS; way++) {
+        vcache_entry *e = &set[way];
+        uint64_t seq = atomic_load_explicit(&e->seq, memory_order_acquire);
+        int match = !(seq & 1);
+        for (int w = 0; w < VCACHE_WORDS; w++) {
+            match &= atomic_load_explicit(&e->key[w], memory_order_relaxed) == key[w];
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (match && atomic_load_explicit(&e->seq, memory_order_relaxed) == seq) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void vcache_insert(verify_cache *vc, const uint64_t key[VCACHE_WORDS]) {
+    vcache_entry *set = vcache_set(vc, key);
+    // A never-written way if the set has one, else a victim from key bits
+    // the set index did not use (a fixed victim alone makes two keys that
+    // share a set and a way evict each other on every insert)
+    vcache_entry *e = &set[(key[1] >> 32) % VCACHE_WAYS];
+    for (int way = 0; way < VCACHE_WAYS; way++) {
+        if (atomic_load_explicit(&set[way].seq, memory_order_relaxed) == 0) {
+            e = &set[way];
+            break;
+        }
+    }
+    uint64_t seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+
+    if ((seq & 1) || !atomic_compare_exchange_strong_explicit(
+            &e->seq, &seq, seq + 1, memory_order_acquire, memory_order_relaxed)) {
+        return;
+    }
+    atomic_thread_fence(memory_order_release);
+    for (int w = 0; w < VCACHE_WORDS; w++) {
+        atomic_store_explicit(&e->key[w], key[w], memory_order_relaxed);
+    }
+    atomic_store_explicit(&e->seq, seq + 2, memory_order_release);
+    atomic_fetch_add_explicit(&vc->inserts, 1, memory_order_relaxed);
+}
+
+/* Verify through the cache once tr is known; shared by both key forms */
+static int verify_cached_tr(const uint8_t *sig, size_t siglen,
+                            const uint8_t *m, size_t mlen,
+                            const uint8_t tr[TRBYTES], const public_key *pk,
+                            const prepared_pk *ppk, verify_cache *vc) {
+    uint64_t key[VCACHE_WORDS];
+    uint8_t mu[CRHBYTES];
+    int ret;
+
+    vcache_key(key, tr, sig, m, mlen);
+    if (vcache_lookup(vc, key)) {
+        atomic_fetch_add_explicit(&vc->hits, 1, memory_order_relaxed);
+        return 0;
+    }
+    atomic_fetch_add_explicit(&vc->misses, 1, memory_order_relaxed);
+
+    compute_mu(mu, tr, m, mlen);
+    if (ppk) {
+        ret = verify_prepared_mu(sig, siglen, mu, ppk);
+    } else {
+        ret = dilithium_verify_mu(sig, mu, pk);
+    }
+    if (ret == 0) vcache_insert(vc, key);
+    return ret;
+}
+
+/* tr is derived here, never taken from the caller: a cache entry is only
+ * as trustworthy as the binding between its tr and the key that verified */
+int verify_cached(const uint8_t *sig, size_t siglen, const uint8_t *m,
+                  size_t mlen, const public_key *pk, verify_cache *vc) {
+    uint8_t tr[TRBYTES];
+
+    if (!vc) return dilithium_verify_len(sig, siglen, m, mlen, pk);
+    if (siglen != SIGBYTES) return -1;
+    compute_tr(tr, pk);
+    return verify_cached_tr(sig, siglen, m, mlen, tr, pk, NULL, vc);
+}
+
+int verify_prepared_cached(const uint8_t *sig, size_t siglen, const uint8_t *m,
+                           size_t mlen, const prepared_pk *ppk, verify_cache *vc) {
+    if (!vc) return verify_prepared(sig, siglen, m, mlen, ppk);
+    if (siglen != SIGBYTES) return -1;
+    return verify_cached_tr(sig, siglen, m, mlen, ppk->tr, NULL, ppk, vc);
+}
+
+// ============================================================================
+// DEMO MAIN FUNCTION
+// ============================================================================
+#ifndef DILITHIUM_NO_SIGN_MAIN
+
+/* One SHAKE-256 call per mask poly; the reference for expand_mask */
+static void expand_mask_scalar(polyvecl *y, const uint8_t rhoprime[CRHBYTES],
+                               uint16_t nonce) {
+    uint8_t buf[POLYZ_PACKEDBYTES];
+    uint8_t in[CRHBYTES + 2];
+
+    memcpy(in, rhoprime, CRHBYTES);
+    for (int i = 0; i < L; i++) {
+        uint16_t n = L * nonce + i;
+        in[CRHBYTES] = n & 0xFF;
+        in[CRHBYTES + 1] = n >> 8;
+        shake256(buf, POLYZ_PACKEDBYTES, in, sizeof(in));
+        for (int k = 0; k < N / 8; k++) {
+            uint32_t t[8];
+            unpack_block8(t, buf + 18 * k, 18);
+            for (int j = 0; j < 8; j++) {
+                y->vec[i].coeffs[8 * k + j] = GAMMA1 - (int32_t)t[j];
+            }
+        }
+    }
+}
+
+/* Byte-at-a-time through shake_squeeze; the reference for sample_in_ball */
+static void sample_in_ball_bytewise(poly *c, const uint8_t c_tilde[CTILDEBYTES]) {
+    keccak_state st;
+    uint8_t buf[8];
+    uint64_t signs = 0;
+
+    shake_init(&st, 256);
+    shake_absorb(&st, c_tilde, CTILDEBYTES);
+    shake_finalize(&st);
+
+    shake_squeeze(&st, buf, 8);
+    for (int i = 0; i < 8; i++) {
+        signs |= (uint64_t)buf[i] << (8 * i);
+    }
+
+    poly_zero(c);
+    for (int i = N - TAU; i < N; i++) {
+        uint8_t b;
+        do {
+            shake_squeeze(&st, &b, 1);
+        } while (b > i);
+
+        c->coeffs[i] = c->coeffs[b];
+        c->coeffs[b] = 1 - 2 * (int32_t)(signs & 1);
+        signs >>= 1;
+    }
+}
+
+#define BATCH_COUNT 8
+#define TAIL_COUNT 64
+#define SPEC_WIDTH 4
+#define POOL_CAPACITY 256       // ~2.2 MiB of (y, w, w1) entries
+#define POOL_SIGS 32
+#define STREAM_BYTES (256 * 1024)
+#define STREAM_CHUNK 4096
+#define EXPAND_REPS 16
+#define ORDER_REPS 64
+#define MASK_REPS 200
+#define BALL_REPS 2000
+#define VERIFY_KEYS 3
+#define VERIFY_COUNT 12
+#define FLOOD_REPS 2000
+#define PPK_PATH "/tmp/dilithium_demo.ppk"
+#define IOV_PAYLOAD 4096
+#define PROXY_BYTES (1 << 20)
+#define PROXY_CHUNK 1500
+#define TENANTS 256
+#define TENANT_SIGNS 400
+#define HOT_TENANTS 4
+#define LOAD_REPS 32
+#define PACK_REPS 20000
+#define PCT_REPS 16
+#define BUS_MSGS 32
+#define BUS_DELIVERIES 4
+#define STATS_SIGS 200
+#define SPEC_STATS_SIGS 16
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Sorted latencies -> p50 / p99 / max line */
+static void print_tail(const char *label, double *us, int count) {
+    qsort(us, count, sizeof(double), cmp_double);
+    printf("  %-22s p50 %8.1f us   p99 %8.1f us   max %8.1f us\n", label,
+           us[count / 2], us[(count * 99) / 100], us[count - 1]);
+}
+
+int main() {
+    static public_key pk;
+    static secret_key sk;
+    static uint8_t sig[SIGBYTES];
+    const char *msg = "Hello, Dilithium!";
+    
+    printf("=== Dilithium Signing Demo ===\n\n");
+    printf("Parameters:\n");
+    printf("  γ1 = 2^17, γ2 = (Q-1)/88, τ = %d, β = %d, ω = %d\n",
+           TAU, BETA, OMEGA);
+    printf("  Signature size = %d bytes\n\n", SIGBYTES);
+    
+    dilithium_keygen(&pk, &sk);
+    
+    printf("\n=== Sign / Verify ===\n\n");
+    double start = now_ns();
+    dilithium_sign(sig, (const uint8_t *)msg, strlen(msg), &sk, NULL);
+    double sign_us = (now_ns() - start) / 1e3;
+    
+    printf("Message: \"%s\"\n", msg);
+    printf("Signature (first 16 bytes): ");
+    for (int i = 0; i < 16; i++) {
+        printf("%02x", sig[i]);
+    }
+    printf("...\n  signed in %.1f us\n\n", sign_us);
+    
+    int valid = dilithium_verify(sig, (const uint8_t *)msg, strlen(msg), &pk) == 0;
+    printf("Verify original message:  %s\n", valid ? "✓ VALID" : "✗ INVALID");
+    
+    const char *forged = "Hello, Dilithium?";
+    int rejected = dilithium_verify(sig, (const uint8_t *)forged,
+                                    strlen(forged), &pk) != 0;
+    printf("Verify altered message:   %s\n",
+           rejected ? "✓ REJECTED" : "✗ ACCEPTED");
+    
+    sig[CTILDEBYTES] ^= 1;
+    rejected = dilithium_verify(sig, (const uint8_t *)msg, strlen(msg), &pk) != 0;
+    printf("Verify altered signature: %s\n",
+           rejected ? "✓ REJECTED" : "✗ ACCEPTED");
+    
+    // Batch signing must produce exactly the one-at-a-time signatures
+    printf("\n=== Batch Signing (%d messages, %d SHAKE lanes) ===\n\n",
+           BATCH_COUNT, SHAKE_LANES);
+    static uint8_t batch_sigs[BATCH_COUNT][SIGBYTES];
+    static uint8_t seq_sigs[BATCH_COUNT][SIGBYTES];
+    char texts[BATCH_COUNT][32];
+    const uint8_t *msgs[BATCH_COUNT];
+    size_t mlens[BATCH_COUNT];
+    
+    for (int i = 0; i < BATCH_COUNT; i++) {
+        snprintf(texts[i], sizeof(texts[i]), "Batch message #%d", i);
+        msgs[i] = (const uint8_t *)texts[i];
+        mlens[i] = strlen(texts[i]);
+    }
+    
+    // Baseline: the same expanded key, one message at a time
+    expanded_sk *batch_esk = expanded_sk_new(&sk, 1);
+    start = now_ns();
+    for (int i = 0; i < BATCH_COUNT; i++) {
+        sign_expanded(seq_sigs[i], msgs[i], mlens[i], batch_esk, NULL);
+    }
+    double seq_us = (now_ns() - start) / 1e3;
+    expanded_sk_free(batch_esk);
+    
+    start = now_ns();
+    sign_batch(&sk, msgs, mlens, batch_sigs, BATCH_COUNT, NULL);
+    double batch_us = (now_ns() - start) / 1e3;
+    
+    int all_valid = 1;
+    for (int i = 0; i < BATCH_COUNT; i++) {
+        all_valid &= dilithium_verify(batch_sigs[i], msgs[i], mlens[i], &pk) == 0;
+    }
+    int identical = memcmp(batch_sigs, seq_sigs, sizeof(seq_sigs)) == 0;
+    
+    printf("  Sequential: %10.1f us/signature\n", seq_us / BATCH_COUNT);
+    printf("  Batch:      %10.1f us/signature\n", batch_us / BATCH_COUNT);
+    printf("  All batch signatures verify: %s\n", all_valid ? "✓ YES" : "✗ NO");
+    printf("  Identical to sequential:     %s\n", identical ? "✓ YES" : "✗ NO");
+    
+    // Tail latency: sequential attempts vs SPEC_WIDTH nonces per round
+    printf("\n=== Speculative Signing (%d signatures, width %d) ===\n\n",
+           TAIL_COUNT, SPEC_WIDTH);
+    prepared_sk *psk = aligned_alloc(ARENA_ALIGN, sizeof(prepared_sk));
+    static double seq_lat[TAIL_COUNT], spec_lat[TAIL_COUNT];
+    static uint8_t spec_sig[SIGBYTES];
+    int same = 1;
+    
+    prepare_sk(psk, &sk);
+    latency_mode_enable(SPEC_WIDTH);
+    for (int i = 0; i < TAIL_COUNT; i++) {
+        char text[32];
+        snprintf(text, sizeof(text), "Tail message #%d", i);
+        
+        start = now_ns();
+        sign_prepared(sig, (const uint8_t *)text, strlen(text), psk, NULL);
+        seq_lat[i] = (now_ns() - start) / 1e3;
+        
+        start = now_ns();
+        sign_speculative(spec_sig, (const uint8_t *)text, strlen(text), psk,
+                         NULL, SPEC_WIDTH);
+        spec_lat[i] = (now_ns() - start) / 1e3;
+        
+        same &= memcmp(sig, spec_sig, SIGBYTES) == 0;
+    }
+    latency_mode_disable();
+    free(psk);
+    
+    print_tail("Sequential:", seq_lat, TAIL_COUNT);
+    print_tail("Speculative:", spec_lat, TAIL_COUNT);
+    printf("  Latency threads: %d (cores online: %ld)\n", SPEC_WIDTH,
+           sysconf(_SC_NPROCESSORS_ONLN));
+    printf("  Identical to sequential: %s\n", same ? "✓ YES" : "✗ NO");
+    
+    // Online latency once the commitments were computed ahead of time
+    printf("\n=== Offline/Online Signing (%d signatures, pool of %d) ===\n\n",
+           POOL_SIGS, POOL_CAPACITY);
+    prepared_sk *pool_psk = aligned_alloc(ARENA_ALIGN, sizeof(prepared_sk));
+    static double full_lat[POOL_SIGS], online_lat[POOL_SIGS];
+    size_t hits, misses;
+    int pooled_valid = 1;
+    
+    prepare_sk(pool_psk, &sk);
+    commit_pool *pool = commit_pool_new(pool_psk, POOL_CAPACITY);
+    start = now_ns();
+    commit_pool_fill(pool);
+    double fill_ms = (now_ns() - start) / 1e6;
+    
+    for (int i = 0; i < POOL_SIGS; i++) {
+        char text[32];
+        snprintf(text, sizeof(text), "Pooled message #%d", i);
+        
+        start = now_ns();
+        sign_prepared(sig, (const uint8_t *)text, strlen(text), pool_psk, NULL);
+        full_lat[i] = (now_ns() - start) / 1e3;
+        
+        start = now_ns();
+        sign_pooled(sig, (const uint8_t *)text, strlen(text), pool);
+        online_lat[i] = (now_ns() - start) / 1e3;
+        
+        pooled_valid &= dilithium_verify(sig, (const uint8_t *)text,
+                                         strlen(text), &pk) == 0;
+    }
+    commit_pool_stats(pool, &hits, &misses);
+    commit_pool_free(pool);
+    free(pool_psk);
+    
+    print_tail("Full (sign_prepared):", full_lat, POOL_SIGS);
+    print_tail("Online (sign_pooled):", online_lat, POOL_SIGS);
+    printf("  Initial fill: %.1f ms (%.1f us/entry)\n", fill_ms,
+           fill_ms * 1e3 / POOL_CAPACITY);
+    printf("  Attempts from pool: %zu, built inline: %zu\n", hits, misses);
+    printf("  All pooled signatures verify: %s\n",
+           pooled_valid ? "✓ YES" : "✗ NO");
+    // Streaming: mu computed chunk by chunk from the public key alone
+    printf("\n=== External mu (%d KiB message in %d-byte chunks) ===\n\n",
+           STREAM_BYTES / 1024, STREAM_CHUNK);
+    static uint8_t big[STREAM_BYTES];
+    uint8_t tr[TRBYTES], mu[CRHBYTES];
+    keccak_state mu_ctx;
+    
+    for (int i = 0; i < STREAM_BYTES; i++) {
+        big[i] = (uint8_t)test_rand64();
+    }
+    compute_tr(tr, &pk);
+    mu_init(&mu_ctx, tr);
+    for (int off = 0; off < STREAM_BYTES; off += STREAM_CHUNK) {
+        mu_update(&mu_ctx, big + off, STREAM_CHUNK);
+    }
+    mu_final(&mu_ctx, mu);
+    
+    psk = aligned_alloc(ARENA_ALIGN, sizeof(prepared_sk));
+    prepare_sk(psk, &sk);
+    sign_mu(sig, mu, psk, NULL);
+    free(psk);
+    dilithium_sign(spec_sig, big, STREAM_BYTES, &sk, NULL);
+    
+    printf("  sign_mu matches dilithium_sign:  %s\n",
+           memcmp(sig, spec_sig, SIGBYTES) == 0 ? "✓ YES" : "✗ NO");
+    printf("  dilithium_verify accepts it:     %s\n",
+           dilithium_verify(sig, big, STREAM_BYTES, &pk) == 0 ? "✓ YES" : "✗ NO");
+    
+    // Key forms: load cost, footprint and signing time per form
+    printf("\n=== Secret Key Forms (%d signatures each) ===\n\n", EXPAND_REPS);
+    printf("  %-24s %10s %10s %12s\n", "Form", "Bytes", "Load us", "Sign us");
+    
+    for (int form = 0; form < 3; form++) {
+        static const char *names[3] = {
+            "prepared (A, plain)", "expanded (NTT, no A)", "expanded (NTT + A)"
+        };
+        expanded_sk *esk = NULL;
+        size_t bytes;
+        int match = 1;
+        
+        start = now_ns();
+        if (form == 0) {
+            psk = aligned_alloc(ARENA_ALIGN, sizeof(prepared_sk));
+            prepare_sk(psk, &sk);
+            bytes = sizeof(prepared_sk);
+        } else {
+            esk = expanded_sk_new(&sk, form == 2);
+            bytes = expanded_sk_bytes(form == 2);
+        }
+        double load_us = (now_ns() - start) / 1e3;
+        
+        static uint8_t form_sigs[EXPAND_REPS][SIGBYTES];
+        char texts[EXPAND_REPS][32];
+        for (int i = 0; i < EXPAND_REPS; i++) {
+            snprintf(texts[i], sizeof(texts[i]), "Key form message #%d", i);
+        }
+        
+        start = now_ns();
+        for (int i = 0; i < EXPAND_REPS; i++) {
+            const uint8_t *text = (const uint8_t *)texts[i];
+            if (form == 0) {
+                sign_prepared(form_sigs[i], text, strlen(texts[i]), psk, NULL);
+            } else {
+                sign_expanded(form_sigs[i], text, strlen(texts[i]), esk, NULL);
+            }
+        }
+        double sign_us = (now_ns() - start) / 1e3 / EXPAND_REPS;
+        
+        for (int i = 0; i < EXPAND_REPS; i++) {
+            dilithium_sign(sig, (const uint8_t *)texts[i], strlen(texts[i]),
+                           &sk, NULL);
+            match &= memcmp(sig, form_sigs[i], SIGBYTES) == 0;
+        }
+        
+        printf("  %-24s %10zu %10.1f %12.1f  %s\n", names[form], bytes,
+               load_us, sign_us, match ? "✓" : "✗ MISMATCH");
+        free(psk);
+        psk = NULL;
+        expanded_sk_free(esk);
+    }
+    
+    // Rejection check ordering: same signatures, less work per rejection
+    printf("\n=== Rejection Check Order (%d signatures, expanded key) ===\n\n",
+           ORDER_REPS);
+    expanded_sk *esk = expanded_sk_new(&sk, 1);
+    static uint8_t order_sigs[2][ORDER_REPS][SIGBYTES];
+    double order_us[2];
+    
+    for (int lazy = 0; lazy <= 1; lazy++) {
+        sign_set_lazy_checks(lazy);
+        start = now_ns();
+        for (int i = 0; i < ORDER_REPS; i++) {
+            char text[32];
+            snprintf(text, sizeof(text), "Order message #%d", i);
+            sign_expanded(order_sigs[lazy][i], (const uint8_t *)text,
+                          strlen(text), esk, NULL);
+        }
+        order_us[lazy] = (now_ns() - start) / 1e3 / ORDER_REPS;
+    }
+    expanded_sk_free(esk);
+    
+    printf("  Eager (compute all, then check): %8.1f us/signature\n", order_us[0]);
+    printf("  Lazy (early abort):              %8.1f us/signature\n", order_us[1]);
+    printf("  Identical signatures: %s\n",
+           memcmp(order_sigs[0], order_sigs[1], sizeof(order_sigs[0])) == 0
+               ? "✓ YES" : "✗ NO");
+    
+    // ExpandMask: one four-way squeeze vs L scalar SHAKE-256 calls
+    printf("\n=== ExpandMask (%d polys, %d bytes each) ===\n\n", L,
+           POLYZ_PACKEDBYTES);
+    static polyvecl y_ref, y_x4;
+    uint8_t rho_test[CRHBYTES];
+    int mask_ok = 1;
+    double mask_us[2];
+    
+    for (int i = 0; i < CRHBYTES; i++) {
+        rho_test[i] = (uint8_t)test_rand64();
+    }
+    for (int impl = 0; impl < 2; impl++) {
+        start = now_ns();
+        for (int r = 0; r < MASK_REPS; r++) {
+            if (impl == 0) expand_mask_scalar(&y_ref, rho_test, r);
+            else expand_mask(&y_x4, rho_test, r);
+        }
+        mask_us[impl] = (now_ns() - start) / 1e3 / MASK_REPS;
+    }
+    for (int r = 0; r < 8; r++) {
+        expand_mask_scalar(&y_ref, rho_test, r);
+        expand_mask(&y_x4, rho_test, r);
+        mask_ok &= memcmp(&y_ref, &y_x4, sizeof(polyvecl)) == 0;
+    }
+    
+    printf("  Scalar (L x shake256):  %8.1f us\n", mask_us[0]);
+    printf("  Four-way (shake256x4):  %8.1f us\n", mask_us[1]);
+    printf("  Outputs identical: %s\n", mask_ok ? "✓ YES" : "✗ NO");
+    
+    // SampleInBall: per-byte squeeze vs reading whole blocks in place
+    printf("\n=== SampleInBall (τ = %d) ===\n\n", TAU);
+    static poly c_ref, c_fast, prod_ref, prod_sparse;
+    sparse_poly c_sparse;
+    uint8_t seed_c[CTILDEBYTES];
+    int ball_ok = 1;
+    double ball_us[2];
+    
+    for (int impl = 0; impl < 2; impl++) {
+        start = now_ns();
+        for (int r = 0; r < BALL_REPS; r++) {
+            seed_c[0] = (uint8_t)r;
+            seed_c[1] = (uint8_t)(r >> 8);
+            if (impl == 0) sample_in_ball_bytewise(&c_ref, seed_c);
+            else sample_in_ball(&c_fast, &c_sparse, seed_c);
+        }
+        ball_us[impl] = (now_ns() - start) / 1e3 / BALL_REPS;
+    }
+    for (int r = 0; r < 64; r++) {
+        for (int i = 0; i < CTILDEBYTES; i++) {
+            seed_c[i] = (uint8_t)test_rand64();
+        }
+        sample_in_ball_bytewise(&c_ref, seed_c);
+        sample_in_ball(&c_fast, &c_sparse, seed_c);
+        ball_ok &= memcmp(&c_ref, &c_fast, sizeof(poly)) == 0;
+    }
+    
+    start = now_ns();
+    poly_multiply(&prod_ref, &c_fast, &sk.t0.vec[0]);
+    double dense_us = (now_ns() - start) / 1e3;
+    start = now_ns();
+    poly_mul_sparse(&prod_sparse, &c_sparse, &sk.t0.vec[0]);
+    double sparse_us = (now_ns() - start) / 1e3;
+    
+    printf("  Byte-wise squeeze:    %8.2f us\n", ball_us[0]);
+    printf("  Block fast path:      %8.2f us (dense + sparse output)\n", ball_us[1]);
+    printf("  Outputs identical: %s\n", ball_ok ? "✓ YES" : "✗ NO");
+    printf("  c*t0 schoolbook %.1f us, sparse %.1f us, equal: %s\n",
+           dense_us, sparse_us,
+           memcmp(&prod_ref, &prod_sparse, sizeof(poly)) == 0 ? "✓ YES" : "✗ NO");
+    
+    // Batch verification over several keys, with one forged item
+    printf("\n=== Batch Verification (%d items, %d keys) ===\n\n",
+           VERIFY_COUNT, VERIFY_KEYS);
+    static public_key vpk[VERIFY_KEYS];
+    static secret_key vsk[VERIFY_KEYS];
+    static uint8_t vsigs[VERIFY_COUNT][SIGBYTES];
+    static char vtexts[VERIFY_COUNT][32];
+    verify_item vitems[VERIFY_COUNT];
+    int vresults[VERIFY_COUNT], expected_ok = 1;
+    
+    for (int k = 0; k < VERIFY_KEYS; k++) {
+        dilithium_keygen(&vpk[k], &vsk[k]);
+    }
+    for (int i = 0; i < VERIFY_COUNT; i++) {
+        int k = i % VERIFY_KEYS;
+        snprintf(vtexts[i], sizeof(vtexts[i]), "Gateway message #%d", i);
+        esk = expanded_sk_new(&vsk[k], 1);
+        sign_expanded(vsigs[i], (const uint8_t *)vtexts[i], strlen(vtexts[i]),
+                      esk, NULL);
+        expanded_sk_free(esk);
+        vitems[i].pk = &vpk[k];
+        vitems[i].m = (const uint8_t *)vtexts[i];
+        vitems[i].mlen = strlen(vtexts[i]);
+        vitems[i].sig = vsigs[i];
+    }
+    vitems[5].pk = &vpk[(5 + 1) % VERIFY_KEYS];   // Wrong key for item 5
+    
+    start = now_ns();
+    for (int i = 0; i < VERIFY_COUNT; i++) {
+        dilithium_verify(vitems[i].sig, vitems[i].m, vitems[i].mlen, vitems[i].pk);
+    }
+    double vseq_us = (now_ns() - start) / 1e3 / VERIFY_COUNT;
+    
+    start = now_ns();
+    verify_batch(vitems, vresults, VERIFY_COUNT);
+    double vbatch_us = (now_ns() - start) / 1e3 / VERIFY_COUNT;
+    
+    printf("\n  Results: ");
+    for (int i = 0; i < VERIFY_COUNT; i++) {
+        printf("%c", vresults[i] == 0 ? '+' : 'x');
+        expected_ok &= (vresults[i] == 0) == (i != 5);
+    }
+    printf("  (item 5 carries the wrong key)\n");
+    printf("  Per-item results as expected: %s\n", expected_ok ? "✓ YES" : "✗ NO");
+    printf("  dilithium_verify: %8.1f us/item\n", vseq_us);
+    printf("  verify_batch:     %8.1f us/item\n", vbatch_us);
+    for (int n = 1; n <= SHAKE_LANES; n++) {
+        start = now_ns();
+        verify_batch(vitems, vresults, n);
+        printf("    batch of %d:     %8.1f us/item\n", n,
+               (now_ns() - start) / 1e3 / n);
+    }
+    
+    // Hostile input: rejection cost per class of malformed signature
+    printf("\n=== Early Rejection (%d tries per class) ===\n\n", FLOOD_REPS);
+    static uint8_t bad[SIGBYTES];
+    const uint8_t *vmsg = vitems[0].m;
+    size_t vlen = vitems[0].mlen;
+    
+    for (int cls = 0; cls < 4; cls++) {
+        static const char *names[4] = {
+            "valid signature", "wrong length", "random bytes", "z out of range"
+        };
+        int reps = cls == 0 ? 20 : FLOOD_REPS, accepted = 0;
+        size_t len = cls == 1 ? SIGBYTES - 1 : SIGBYTES;
+        
+        memcpy(bad, vsigs[0], SIGBYTES);
+        if (cls == 2) {
+            for (int i = 0; i < SIGBYTES; i++) bad[i] = (uint8_t)test_rand64();
+        }
+        if (cls == 3) {
+            // Last z group: t = 0 decodes to z = GAMMA1
+            memset(bad + CTILDEBYTES + L * POLYZ_PACKEDBYTES - 9, 0, 9);
+        }
+        
+        start = now_ns();
+        for (int r = 0; r < reps; r++) {
+            accepted += dilithium_verify_len(bad, len, vmsg, vlen, vitems[0].pk) == 0;
+        }
+        printf("  %-16s %10.2f us  (%d/%d accepted)\n", names[cls],
+               (now_ns() - start) / 1e3 / reps, accepted, reps);
+    }
+    
+    // Prepared public key: build once, then mmap and verify with no parsing
+    printf("\n=== Prepared Public Key File (%zu bytes) ===\n\n",
+           sizeof(prepared_pk));
+    start = now_ns();
+    int wrote = prepared_pk_write(PPK_PATH, vitems[0].pk) == 0;
+    double write_us = (now_ns() - start) / 1e3;
+    
+    start = now_ns();
+    const prepared_pk *ppk = prepared_pk_map(PPK_PATH);
+    double map_us = (now_ns() - start) / 1e3;
+    
+    if (wrote && ppk) {
+        start = now_ns();
+        int pvalid = verify_prepared(vsigs[0], SIGBYTES, vmsg, vlen, ppk) == 0;
+        double pverify_us = (now_ns() - start) / 1e3;
+        int prejected = verify_prepared(vsigs[1], SIGBYTES, vmsg, vlen, ppk) != 0;
+        
+        printf("  Prepare + write:   %8.1f us\n", write_us);
+        printf("  mmap + check:      %8.1f us\n", map_us);
+        printf("  verify_prepared:   %8.1f us  %s\n", pverify_us,
+               pvalid ? "✓ VALID" : "✗ INVALID");
+        printf("  Wrong message:     %s\n", prejected ? "✓ REJECTED" : "✗ ACCEPTED");
+        prepared_pk_unmap(ppk);
+    }
+    unlink(PPK_PATH);
+    
+    // Scatter-gather: header, payload and trailer hashed where they live
+    printf("\n=== Segmented Messages (iovec) ===\n\n");
+    static uint8_t payload[IOV_PAYLOAD], joined[IOV_PAYLOAD + 64];
+    const char *header = "POST /artifact HTTP/1.1\r\n\r\n", *trailer = "\r\n--end";
+    struct iovec segs[3] = {
+        { (void *)header, strlen(header) },
+        { payload, IOV_PAYLOAD },
+        { (void *)trailer, strlen(trailer) },
+    };
+    size_t joined_len = 0;
+    
+    for (int i = 0; i < IOV_PAYLOAD; i++) payload[i] = (uint8_t)test_rand64();
+    for (int i = 0; i < 3; i++) {
+        memcpy(joined + joined_len, segs[i].iov_base, segs[i].iov_len);
+        joined_len += segs[i].iov_len;
+    }
+    
+    esk = expanded_sk_new(&sk, 1);
+    sign_expanded_iov(sig, segs, 3, esk, NULL);
+    sign_expanded(spec_sig, joined, joined_len, esk, NULL);
+    expanded_sk_free(esk);
+    
+    printf("  Segments: %zu + %zu + %zu bytes\n", segs[0].iov_len,
+           segs[1].iov_len, segs[2].iov_len);
+    printf("  Same signature as the joined message: %s\n",
+           memcmp(sig, spec_sig, SIGBYTES) == 0 ? "✓ YES" : "✗ NO");
+    printf("  dilithium_verify_iov accepts it:      %s\n",
+           dilithium_verify_iov(sig, SIGBYTES, segs, 3, &pk) == 0 ? "✓ YES" : "✗ NO");
+    
+    // Streaming: a 1 MiB message fed in packet-sized chunks
+    printf("\n=== Streaming Sign and Verify ===\n\n");
+    static uint8_t proxy[PROXY_BYTES];
+    prepared_pk *spk = aligned_alloc(ARENA_ALIGN, sizeof(prepared_pk));
+    expanded_sk *sesk = expanded_sk_new(&sk, 1);
+    sign_ctx sctx;
+    verify_ctx vctx;
+    double t_update = 0, t_flat, t_final;
+    
+    for (size_t i = 0; i < PROXY_BYTES; i += 8) {
+        uint64_t r = test_rand64();
+        memcpy(proxy + i, &r, 8);
+    }
+    prepare_pk(spk, &pk);
+    
+    sign_init(&sctx, sesk);
+    for (size_t off = 0; off < PROXY_BYTES; off += PROXY_CHUNK) {
+        size_t len = PROXY_BYTES - off < PROXY_CHUNK ? PROXY_BYTES - off : PROXY_CHUNK;
+        start = now_ns();
+        sign_update(&sctx, proxy + off, len);
+        t_update += now_ns() - start;
+    }
+    start = now_ns();
+    sign_final(&sctx, sig, NULL);
+    t_final = now_ns() - start;
+    sign_expanded(spec_sig, proxy, PROXY_BYTES, sesk, NULL);
+    
+    start = now_ns();
+    compute_mu(mu, sesk->tr, proxy, PROXY_BYTES);
+    t_flat = now_ns() - start;
+    
+    verify_init(&vctx, spk);
+    for (size_t off = 0; off < PROXY_BYTES; off += PROXY_CHUNK) {
+        size_t len = PROXY_BYTES - off < PROXY_CHUNK ? PROXY_BYTES - off : PROXY_CHUNK;
+        verify_update(&vctx, proxy + off, len);
+    }
+    int svalid = verify_final(&vctx, sig, SIGBYTES) == 0;
+    
+    proxy[PROXY_BYTES / 2] ^= 1;
+    verify_init(&vctx, spk);
+    for (size_t off = 0; off < PROXY_BYTES; off += PROXY_CHUNK) {
+        size_t len = PROXY_BYTES - off < PROXY_CHUNK ? PROXY_BYTES - off : PROXY_CHUNK;
+        verify_update(&vctx, proxy + off, len);
+    }
+    int srejected = verify_final(&vctx, sig, SIGBYTES) != 0;
+    
+    printf("  Message: %d bytes in %d-byte chunks, context %zu bytes\n",
+           PROXY_BYTES, PROXY_CHUNK, sizeof(sign_ctx));
+    printf("  Same signature as one-shot signing:  %s\n",
+           memcmp(sig, spec_sig, SIGBYTES) == 0 ? "✓ YES" : "✗ NO");
+    printf("  Streamed verification accepts it:    %s\n", svalid ? "✓ YES" : "✗ NO");
+    printf("  Flipped bit in transit rejected:     %s\n", srejected ? "✓ YES" : "✗ NO");
+    printf("  Absorb: chunked %.1f MB/s, contiguous %.1f MB/s\n",
+           PROXY_BYTES / (t_update / 1e3), PROXY_BYTES / (t_flat / 1e3));
+    printf("  Absorb %.1f us vs sign_final %.1f us\n", t_update / 1e3,
+           t_final / 1e3);
+    expanded_sk_free(sesk);
+    free(spk);
+    
+    // Seed-only keys: many cold tenants, a few hot ones resident
+    printf("\n=== Seed-Only Secret Keys ===\n\n");
+    static seed_sk tenants[TENANTS];
+    seed_sk_cache tcache;
+    struct { public_key pk; secret_key sk; } *full = malloc(sizeof(*full));
+    uint8_t xi[SEEDBYTES];
+    int tsame = 1, tvalid = 1;
+    double t_hot = 0, t_cold = 0;
+    int n_hot = 0, n_cold = 0;
+    
+    for (int i = 0; i < TENANTS; i++) {
+        for (int b = 0; b < SEEDBYTES; b++) xi[b] = (uint8_t)test_rand64();
+        seed_sk_init(&tenants[i], xi);
+    }
+    seed_sk_cache_init(&tcache, SEED_CACHE_LRU, HOT_TENANTS, 1);
+    
+    for (int i = 0; i < TENANT_SIGNS; i++) {
+        // 90% of traffic goes to the hot tenants
+        uint64_t r = test_rand64();
+        int who = (int)((r >> 8) % (r % 10 ? HOT_TENANTS : TENANTS));
+        int was_hot = tenants[who].esk != NULL;
+        
+        start = now_ns();
+        sign_seed_sk(sig, (const uint8_t *)msg, strlen(msg), &tenants[who], &tcache, NULL);
+        double us = (now_ns() - start) / 1e3;
+        if (was_hot) { t_hot += us; n_hot++; } else { t_cold += us; n_cold++; }
+        
+        if (i % 50 == 0) {
+            dilithium_keygen_from_seed(&full->pk, &full->sk, tenants[who].xi);
+            esk = expanded_sk_new(&full->sk, 0);
+            sign_expanded(spec_sig, (const uint8_t *)msg, strlen(msg), esk, NULL);
+            expanded_sk_free(esk);
+            tsame &= memcmp(sig, spec_sig, SIGBYTES) == 0;
+            tvalid &= dilithium_verify(sig, (const uint8_t *)msg, strlen(msg), &full->pk) == 0;
+        }
+    }
+    seed_sk_cache_free(&tcache);
+    free(full);
+    
+    printf("  %d tenants: %zu bytes as seed_sk, %zu bytes as secret_key\n", TENANTS,
+           TENANTS * sizeof(seed_sk), TENANTS * sizeof(secret_key));
+    printf("  LRU of %d expansions (%zu bytes each with NTT(A))\n", HOT_TENANTS,
+           expanded_sk_bytes(1));
+    printf("  Hot signs: %d at %.1f us, cold signs: %d at %.1f us\n",
+           n_hot, n_hot ? t_hot / n_hot : 0, n_cold, n_cold ? t_cold / n_cold : 0);
+    printf("  Matches the fully derived key:  %s\n", tsame ? "✓ YES" : "✗ NO");
+    printf("  Verifies under the derived pk:  %s\n", tvalid ? "✓ YES" : "✗ NO");
+    
+    // Per-request loading: unpack everything vs decode on first use
+    printf("\n=== Lazy Secret-Key View ===\n\n");
+    static uint8_t sk_bytes[SECRETKEYBYTES];
+    static secret_key loaded;
+    static sk_view view;
+    double load_us[2] = { 0, 0 };
+    int lsame = 1;
+    
+    pack_sk(sk_bytes, &sk);
+    sk_view_init(&view, sk_bytes);
+    compute_mu(mu, sk_view_tr(&view), (const uint8_t *)msg, strlen(msg));
+    printf("  Polys decoded to compute mu: %d of %d\n",
+           __builtin_popcount(view.ready), L + 2 * K);
+    
+    for (int i = 0; i < LOAD_REPS; i++) {
+        start = now_ns();
+        unpack_sk(&loaded, sk_bytes);
+        esk = expanded_sk_new(&loaded, 0);
+        sign_expanded(sig, (const uint8_t *)msg, strlen(msg), esk, NULL);
+        expanded_sk_free(esk);
+        load_us[0] += (now_ns() - start) / 1e3;
+        
+        start = now_ns();
+        sk_view_init(&view, sk_bytes);
+        sign_view(spec_sig, (const uint8_t *)msg, strlen(msg), &view, NULL);
+        sk_view_clear(&view);
+        load_us[1] += (now_ns() - start) / 1e3;
+        lsame &= memcmp(sig, spec_sig, SIGBYTES) == 0;
+    }
+    
+    printf("  unpack_sk + expand + sign: %.1f us\n", load_us[0] / LOAD_REPS);
+    printf("  sk_view + sign:            %.1f us\n", load_us[1] / LOAD_REPS);
+    printf("  Same signatures:           %s\n", lsame ? "✓ YES" : "✗ NO");
+    
+    int vclear = 1;
+    for (size_t b = 0; b < sizeof(view); b++) vclear &= ((uint8_t *)&view)[b] == 0;
+    printf("  Cleared view holds no key: %s\n", vclear ? "✓ YES" : "✗ NO");
+    
+    // Signature encoding cost next to a whole signature
+    printf("\n=== Signature Packing ===\n\n");
+    static polyvecl pz;
+    static polyveck ph;
+    uint8_t pc[CTILDEBYTES];
+    int pok = unpack_sig(pc, &pz, &ph, sig) == 0;
+    
+    start = now_ns();
+    for (int i = 0; i < PACK_REPS; i++) {
+        pok &= pack_sig(spec_sig, pc, &pz, &ph) == 0;
+    }
+    double pack_ns = (now_ns() - start) / PACK_REPS;
+    start = now_ns();
+    for (int i = 0; i < PACK_REPS; i++) {
+        pok &= unpack_sig(pc, &pz, &ph, spec_sig) == 0;
+    }
+    double unpack_ns = (now_ns() - start) / PACK_REPS;
+    
+    printf("  pack_sig:   %.0f ns\n", pack_ns);
+    printf("  unpack_sig: %.0f ns\n", unpack_ns);
+    printf("  Round trip reproduces the signature: %s\n",
+           pok && memcmp(sig, spec_sig, SIGBYTES) == 0 ? "✓ YES" : "✗ NO");
+    
+    // More than OMEGA hints cannot be encoded and must not be packed
+    for (int j = 0; j <= OMEGA; j++) ph.vec[j % K].coeffs[j / K] = 1;
+    printf("  Overfull hints refused: %s\n",
+           pack_sig(spec_sig, pc, &pz, &ph) != 0 ? "✓ YES" : "✗ NO");
+    
+    // Keygen cost with the built-in test, without it, and with a naive one
+    printf("\n=== Keygen Pairwise Consistency Test (%d keys) ===\n\n", PCT_REPS);
+    static public_key pct_pk;
+    static secret_key pct_sk;
+    double pct_us[3];
+    
+    for (int mode = 0; mode < 3; mode++) {
+        sign_set_keygen_pct(mode == 1);
+        start = now_ns();
+        for (int i = 0; i < PCT_REPS; i++) {
+            random_seed(xi);
+            dilithium_keygen_from_seed(&pct_pk, &pct_sk, xi);
+            if (mode == 2) {
+                dilithium_sign(sig, (const uint8_t *)msg, strlen(msg), &pct_sk, NULL);
+                dilithium_verify(sig, (const uint8_t *)msg, strlen(msg), &pct_pk);
+            }
+        }
+        pct_us[mode] = (now_ns() - start) / 1e3 / PCT_REPS;
+    }
+    sign_set_keygen_pct(0);
+    
+    // A key whose halves disagree must fail the test
+    static poly pct_A[K][L];
+    expand_matrix_a(pct_A, pct_pk.seed);
+    int pct_good = dilithium_pct((const poly (*)[L])pct_A, &pct_pk, &pct_sk) == 0;
+    pct_sk.s1.vec[0].coeffs[0] += 1;
+    int pct_bad = dilithium_pct((const poly (*)[L])pct_A, &pct_pk, &pct_sk) != 0;
+    
+    printf("  keygen:                  %8.1f us\n", pct_us[0]);
+    printf("  keygen + built-in PCT:   %8.1f us\n", pct_us[1]);
+    printf("  keygen + sign + verify:  %8.1f us\n", pct_us[2]);
+    printf("  Fresh key passes:        %s\n", pct_good ? "✓ YES" : "✗ NO");
+    printf("  Mismatched key fails:    %s\n", pct_bad ? "✓ YES" : "✗ NO");
+    
+    // Redelivered messages: each triple verified once, then served from cache
+    printf("\n=== Verification Cache (%d messages x %d deliveries) ===\n\n",
+           BUS_MSGS, BUS_DELIVERIES);
+    static uint8_t bus_sigs[BUS_MSGS][SIGBYTES];
+    char bus_msgs[BUS_MSGS][32];
+    verify_cache *vc = verify_cache_new(1024);
+    double t_miss = 0, t_hit = 0;
+    int bus_ok = 1;
+    uint64_t vc_hits, vc_misses, vc_inserts;
+    prepared_pk *bus_ppk = aligned_alloc(ARENA_ALIGN, sizeof(prepared_pk));
+    
+    prepare_pk(bus_ppk, &pk);
+    for (int i = 0; i < BUS_MSGS; i++) {
+        snprintf(bus_msgs[i], sizeof(bus_msgs[i]), "event %d", i);
+        dilithium_sign(bus_sigs[i], (const uint8_t *)bus_msgs[i], strlen(bus_msgs[i]), &sk, NULL);
+    }
+    for (int d = 0; d < BUS_DELIVERIES; d++) {
+        for (int i = 0; i < BUS_MSGS; i++) {
+            start = now_ns();
+            bus_ok &= verify_cached(bus_sigs[i], SIGBYTES, (const uint8_t *)bus_msgs[i],
+                                    strlen(bus_msgs[i]), &pk, vc) == 0;
+            if (d == 0) t_miss += now_ns() - start; else t_hit += now_ns() - start;
+        }
+    }
+    
+    // The prepared key carries tr, so its hits skip hashing pk
+    double t_ppk_hit = 0;
+    for (int i = 0; i < BUS_MSGS; i++) {
+        start = now_ns();
+        bus_ok &= verify_prepared_cached(bus_sigs[i], SIGBYTES, (const uint8_t *)bus_msgs[i],
+                                         strlen(bus_msgs[i]), bus_ppk, vc) == 0;
+        t_ppk_hit += now_ns() - start;
+    }
+    
+    // A cached triple presented with another key is verified, and fails
+    int bus_wrong_key = verify_cached(bus_sigs[1], SIGBYTES, (const uint8_t *)bus_msgs[1],
+                                      strlen(bus_msgs[1]), &pct_pk, vc) != 0;
+    
+    // A cached message with a different signature byte is verified afresh
+    bus_sigs[0][CTILDEBYTES] ^= 1;
+    int bus_reject = verify_cached(bus_sigs[0], SIGBYTES, (const uint8_t *)bus_msgs[0],
+                                   strlen(bus_msgs[0]), &pk, vc) != 0;
+    bus_reject &= verify_cached(bus_sigs[0], SIGBYTES, (const uint8_t *)bus_msgs[0],
+                                strlen(bus_msgs[0]), &pk, vc) != 0;
+    verify_cache_stats(vc, &vc_hits, &vc_misses, &vc_inserts);
+    verify_cache_free(vc);
+    free(bus_ppk);
+    
+    printf("  First delivery (verify):  %8.1f us\n", t_miss / 1e3 / BUS_MSGS);
+    printf("  Redelivery (cache hit):   %8.1f us\n",
+           t_hit / 1e3 / (BUS_MSGS * (BUS_DELIVERIES - 1)));
+    printf("  Redelivery (prepared pk): %8.1f us\n", t_ppk_hit / 1e3 / BUS_MSGS);
+    printf("  Hits %llu, misses %llu, inserts %llu\n",
+           (unsigned long long)vc_hits, (unsigned long long)vc_misses,
+           (unsigned long long)vc_inserts);
+    printf("  All deliveries accepted:  %s\n", bus_ok ? "✓ YES" : "✗ NO");
+    printf("  Altered signature rejected every time: %s\n", bus_reject ? "✓ YES" : "✗ NO");
+    printf("  Cached triple under another key rejected: %s\n", bus_wrong_key ? "✓ YES" : "✗ NO");
+    
+    // Where signing time goes: attempts, failing checks, per-stage cost
+    printf("\n=== Rejection-Loop Statistics (%d signatures) ===\n\n", STATS_SIGS);
+    static const char *reject_names[SIGN_REJECT_KINDS] = { "z", "r0", "c*t0", "hints" };
+    static const char *stage_names[SIGN_STAGES] = { "ExpandMask", "commit", "challenge", "respond" };
+    sign_stats st;
+    double stats_us[2];
+    
+    esk = expanded_sk_new(&sk, 1);
+    for (int on = 0; on < 2; on++) {
+        sign_stats_reset();
+        sign_stats_enable(on);
+        start = now_ns();
+        for (int i = 0; i < STATS_SIGS; i++) {
+            char text[32];
+            snprintf(text, sizeof(text), "stats %d", i);
+            sign_expanded(sig, (const uint8_t *)text, strlen(text), esk, NULL);
+        }
+        stats_us[on] = (now_ns() - start) / 1e3 / STATS_SIGS;
+    }
+    sign_stats_enable(0);
+    sign_stats_get(&st);
+    expanded_sk_free(esk);
+    
+    printf("  Attempts per signature: %.2f\n", (double)st.attempts / st.signatures);
+    printf("  Histogram (attempts: signatures):\n   ");
+    for (int i = 0; i < SIGN_STATS_HIST; i++) {
+        if (st.attempts_hist[i]) printf(" %d%s:%llu", i + 1, i == SIGN_STATS_HIST - 1 ? "+" : "",
+                                        (unsigned long long)st.attempts_hist[i]);
+    }
+    printf("\n  Rejections by first failing check:\n");
+    uint64_t failed = st.attempts - st.signatures;
+    for (int i = 0; i < SIGN_REJECT_KINDS; i++) {
+        printf("    %-6s %5llu  (%4.1f%%)\n", reject_names[i], (unsigned long long)st.rejects[i],
+               failed ? 100.0 * st.rejects[i] / failed : 0);
+    }
+    printf("  Time per attempt by stage:\n");
+    for (int i = 0; i < SIGN_STAGES; i++) {
+        printf("    %-10s %7.1f us\n", stage_names[i], st.stage_ns[i] / 1e3 / st.timed_attempts);
+    }
+    printf("  Signing with stats off / on: %.1f / %.1f us\n", stats_us[0], stats_us[1]);
+    printf("  Rejections add up: %s\n",
+           st.rejects[0] + st.rejects[1] + st.rejects[2] + st.rejects[3] == failed ? "✓ YES" : "✗ NO");
+    
+    // Speculative rounds must count the same attempts as the sequential loop
+    sign_stats seq_st, spec_st;
+    psk = aligned_alloc(ARENA_ALIGN, sizeof(prepared_sk));
+    prepare_sk(psk, &sk);
+    sign_stats_enable(1);
+    for (int pass = 0; pass < 2; pass++) {
+        sign_stats_reset();
+        for (int i = 0; i < SPEC_STATS_SIGS; i++) {
+            char text[32];
+            snprintf(text, sizeof(text), "stats %d", i);
+            if (pass == 0) {
+                sign_prepared(sig, (const uint8_t *)text, strlen(text), psk, NULL);
+            } else {
+                sign_speculative(sig, (const uint8_t *)text, strlen(text), psk,
+                                 NULL, SPEC_WIDTH);
+            }
+        }
+        sign_stats_get(pass == 0 ? &seq_st : &spec_st);
+    }
+    sign_stats_enable(0);
+    free(psk);
+    
+    printf("  Speculative (width %d): %.2f attempts/signature, %llu discarded\n",
+           SPEC_WIDTH, (double)spec_st.attempts / spec_st.signatures,
+           (unsigned long long)spec_st.discarded);
+    printf("  Same histogram as sequential: %s\n",
+           memcmp(seq_st.attempts_hist, spec_st.attempts_hist,
+                  sizeof(seq_st.attempts_hist)) == 0 ? "✓ YES" : "✗ NO");
+    printf("  Scratch arena peak: %zu bytes\n", scratch_arena()->peak);
+    
+    return 0;
+}
+
+#endif
@@ -0,0 +1,388 @@
+/*
+ * Dilithium Signing - Educational Implementation
+ * Parameters, types and entry points of Dilithium_sign.c
+ */
+
+#ifndef DILITHIUM_SIGN_H
+#define DILITHIUM_SIGN_H
+
+#include <sys/uio.h>
+#include "Dilithium_key_gen.h"
+#include "SHAKE.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ============================================================================
+// PARAMETERS (Dilithium2 variant)
+// ============================================================================
+#define GAMMA1 (1 << 17)          // Mask coefficient range
+#define GAMMA2 ((Q - 1) / 88)     // Low-order rounding range
+#define TAU 39                    // Nonzero coefficients in c
+#define BETA (TAU * ETA)          // Max |c * s| coefficient
+#define OMEGA 80                  // Max hint ones
+#define CRHBYTES 64               // mu and rho'
+#define RNDBYTES 32               // Per-signature randomness
+#define CTILDEBYTES 32            // Challenge seed
+
+// Packed (wire) sizes
+#define POLYZ_PACKEDBYTES  (N * 18 / 8)   // z: 18 bits per coefficient
+#define POLYW1_PACKEDBYTES (N * 6 / 8)    // w1: 6 bits per coefficient
+#define SIGBYTES (CTILDEBYTES + L * POLYZ_PACKEDBYTES + OMEGA + K)
+
+// Challenge c in sparse form: TAU nonzero positions (increasing) and signs
+typedef struct {
+    uint8_t index[TAU];
+    int8_t sign[TAU];
+} sparse_poly;
+
+// One verification request for verify_batch
+typedef struct {
+    const public_key *pk;
+    const uint8_t *m;
+    size_t mlen;
+    const uint8_t *sig;        // SIGBYTES
+} verify_item;
+
+// ============================================================================
+// PREPARED PUBLIC KEY (FILE FORMAT)
+// ============================================================================
+/*
+ * Layout, every section 64-byte aligned, integers in the writer's byte
+ * order (recorded in `endian`):
+ *
+ *     offset      size    field
+ *          0        64    header (magic, version, endian, params, rho)
+ *         64        64    tr = H(pk)
+ *        128   K*L*1024   NTT(A), row-major
+ *     +16384     K*1024   NTT(t1 * 2^D)
+ */
+#define PREPARED_PK_MAGIC "DILPREP"     // 8 bytes with the terminator
+#define PREPARED_PK_VERSION 1
+#define PREPARED_PK_ENDIAN 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t q;
+    uint32_t params;           // K | L << 8 | D << 16
+    uint32_t bytes;            // sizeof(prepared_pk)
+    uint32_t reserved;
+    uint8_t rho[SEEDBYTES];
+} prepared_pk_header;
+
+typedef struct {
+    prepared_pk_header hdr;
+    uint8_t tr[TRBYTES];
+    poly A_hat[K][L];
+    polyveck t1_hat;
+} prepared_pk;
+
+// Set-associative cache of verified (pk, message, signature) triples
+typedef struct verify_cache verify_cache;
+
+// ============================================================================
+// PREPARED SECRET KEY
+// ============================================================================
+/*
+ * Everything signing needs that depends only on the key: the expanded
+ * matrix A plus the secret vectors, K and tr. Building it costs one
+ * ExpandA; every signature made from it skips that work.
+ */
+typedef struct {
+    uint8_t rho[SEEDBYTES];
+    uint8_t key[SEEDBYTES];
+    uint8_t tr[TRBYTES];
+    poly A[K][L];
+    polyvecl s1;
+    polyveck s2;
+    polyveck t0;
+} prepared_sk;
+
+// ============================================================================
+// EXPANDED SECRET KEY
+// ============================================================================
+/*
+ * Load-time form for NTT-based signing. s1, s2 and t0 are stored already
+ * transformed (ready for poly_pointwise_montgomery), so an attempt only
+ * transforms y and c. Fields read on every attempt come first; the
+ * allocation is ARENA_ALIGN aligned and each poly starts a cache line.
+ * With cache_a set, NTT(A) follows the struct in the same allocation
+ * (another K*L KiB); otherwise every signature re-expands it.
+ */
+typedef struct {
+    polyvecl s1_hat;           // NTT(s1)
+    polyveck s2_hat;           // NTT(s2)
+    polyveck t0_hat;           // NTT(t0)
+    poly (*A_hat)[L];          // NTT(A), or NULL when not cached
+    uint8_t rho[SEEDBYTES];
+    uint8_t key[SEEDBYTES];
+    uint8_t tr[TRBYTES];
+} expanded_sk;
+
+// Streaming contexts: the mu sponge mid-absorb and the key it is bound to
+typedef struct {
+    keccak_state st;
+    const expanded_sk *esk;
+} sign_ctx;
+
+typedef struct {
+    keccak_state st;
+    const prepared_pk *ppk;
+} verify_ctx;
+
+// ============================================================================
+// LAZY SECRET-KEY VIEW
+// ============================================================================
+/*
+ * A packed secret key (SECRETKEYBYTES, borrowed) plus slots that fill in
+ * on first use: each of s1, s2 and t0 is decoded poly by poly straight to
+ * its NTT form. `ready` has bit i for s1[i], L + i for s2[i] and L + K + i
+ * for t0[i]. The slots are secret: sk_view_clear() wipes them when done.
+ */
+typedef struct {
+    polyvecl s1_hat;
+    polyveck s2_hat;
+    polyveck t0_hat;
+    const uint8_t *bytes;
+    uint32_t ready;
+} sk_view;
+
+// ============================================================================
+// SEED-ONLY SECRET KEY
+// ============================================================================
+// Compact handle: the keygen master seed plus its cached expansion, if any
+typedef struct {
+    uint8_t xi[SEEDBYTES];
+    expanded_sk *esk;          // Owned by the cache; NULL while cold
+    uint64_t last_use;         // Cache clock at the last signature
+} seed_sk;
+
+#define SEED_CACHE_NONE 0          // Expand for every signature, then drop
+#define SEED_CACHE_LRU 1           // Keep `capacity` expansions, evict LRU
+
+typedef struct {
+    int policy;
+    int cache_a;               // Expansions also hold NTT(A)
+    size_t capacity;
+    size_t count;
+    uint64_t clock;
+    seed_sk **resident;        // Handles currently holding an expansion
+} seed_sk_cache;
+
+// ============================================================================
+// COMMITMENT POOL
+// ============================================================================
+/*
+ * Per-key store of precomputed (y, w = A*y, w1) triples for offline/online
+ * signing. None of them depends on the message, so a background thread
+ * fills the pool while the machine is idle and sign_pooled only hashes the
+ * challenge, forms the response and runs the rejection checks.
+ */
+typedef struct commit_pool commit_pool;
+
+// ============================================================================
+// SIGNING STATISTICS
+// ============================================================================
+#define SIGN_STATS_HIST 16         // attempts_hist[i]: i + 1 attempts; last is 16+
+
+#define SIGN_REJECT_Z 0            // ||z|| >= GAMMA1 - BETA
+#define SIGN_REJECT_R0 1           // ||LowBits(w - c*s2)|| >= GAMMA2 - BETA
+#define SIGN_REJECT_CT0 2          // ||c*t0|| >= GAMMA2
+#define SIGN_REJECT_HINTS 3        // more than OMEGA hints
+#define SIGN_REJECT_KINDS 4
+
+#define SIGN_STAGE_MASK 0          // ExpandMask
+#define SIGN_STAGE_COMMIT 1        // w = A*y, pack HighBits(w)
+#define SIGN_STAGE_CHALLENGE 2     // c_tilde = H(mu || w1)
+#define SIGN_STAGE_RESPOND 3       // z, r0, c*t0, hints and checks
+#define SIGN_STAGES 4
+
+typedef struct {
+    uint64_t signatures;
+    uint64_t attempts;             // Summed over signatures
+    uint64_t attempts_hist[SIGN_STATS_HIST];
+    uint64_t rejects[SIGN_REJECT_KINDS];   // By first failing check
+    uint64_t stage_ns[SIGN_STAGES];
+    uint64_t timed_attempts;       // Attempts behind stage_ns (batch lockstep is untimed)
+    uint64_t discarded;            // Speculative attempts past the accepted nonce
+                                   // (any rejections among them are in rejects)
+} sign_stats;
+
+// ============================================================================
+// SIGNING PRIMITIVES
+// ============================================================================
+int32_t decompose(int32_t *a0, int32_t a);
+int32_t highbits(int32_t a);
+int32_t use_hint(int32_t a, int hint);
+int poly_chknorm(const poly *a, int32_t bound);
+
+void polyz_pack(uint8_t *r, const poly *a);
+void polyz_unpack(poly *r, const uint8_t *a);
+void polyw1_pack(uint8_t *r, const poly *a);
+int polyh_pack(uint8_t *hint, int k, int row, const poly *h);
+int polyh_unpack(poly *h, const uint8_t *hint, int k, int row);
+int pack_sig(uint8_t sig[SIGBYTES], const uint8_t c_tilde[CTILDEBYTES],
+             const polyvecl *z, const polyveck *h);
+int unpack_sig(uint8_t c_tilde[CTILDEBYTES], polyvecl *z, polyveck *h,
+               const uint8_t sig[SIGBYTES]);
+int sig_decode(uint8_t c_tilde[CTILDEBYTES], polyvecl *z, polyveck *h,
+               const uint8_t *sig, size_t siglen);
+
+void compute_mu(uint8_t mu[CRHBYTES], const uint8_t tr[TRBYTES],
+                const uint8_t *m, size_t mlen);
+void compute_mu_iov(uint8_t mu[CRHBYTES], const uint8_t tr[TRBYTES],
+                    const struct iovec *iov, int iovcnt);
+void compute_tr(uint8_t tr[TRBYTES], const public_key *pk);
+void compute_rhoprime(uint8_t rhoprime[CRHBYTES], const uint8_t key[SEEDBYTES],
+                      const uint8_t rnd[RNDBYTES], const uint8_t mu[CRHBYTES]);
+void expand_mask(polyvecl *y, const uint8_t rhoprime[CRHBYTES], uint16_t nonce);
+void sample_in_ball(poly *c, sparse_poly *cs, const uint8_t c_tilde[CTILDEBYTES]);
+void poly_mul_sparse(poly *r, const sparse_poly *c, const poly *s);
+
+// ============================================================================
+// API
+// ============================================================================
+// Signing returns 0, except that the calls which allocate a key form
+// (dilithium_sign, dilithium_sign_iov, sign_seed_sk, sign_batch) return -1
+// when out of memory, leaving sig unwritten. Verification returns 0 for a
+// valid signature, -1 otherwise. A NULL rnd (or rnds array) selects
+// deterministic signing;
+// for hedged signing draw rnd from rng_bytes() (rng_seeds() for batches).
+
+void prepare_sk(prepared_sk *psk, const secret_key *sk);
+
+// Streaming message digest: mu_init(tr), mu_update() per chunk, mu_final().
+// The context holds no secrets, so it may live outside the signer.
+void mu_init(keccak_state *st, const uint8_t tr[TRBYTES]);
+void mu_update(keccak_state *st, const uint8_t *chunk, size_t len);
+void mu_final(keccak_state *st, uint8_t mu[CRHBYTES]);
+int sign_mu(uint8_t sig[SIGBYTES], const uint8_t mu[CRHBYTES],
+            const prepared_sk *psk, const uint8_t rnd[RNDBYTES]);
+int dilithium_verify_mu(const uint8_t sig[SIGBYTES], const uint8_t mu[CRHBYTES],
+                        const public_key *pk);
+
+size_t expanded_sk_bytes(int cache_a);
+expanded_sk *expanded_sk_new(const secret_key *sk, int cache_a);
+void expanded_sk_free(expanded_sk *esk);
+int sign_expanded_mu(uint8_t sig[SIGBYTES], const uint8_t mu[CRHBYTES],
+                     const expanded_sk *esk, const uint8_t rnd[RNDBYTES]);
+int sign_expanded(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+                  const expanded_sk *esk, const uint8_t rnd[RNDBYTES]);
+
+void sk_view_init(sk_view *v, const uint8_t sk_bytes[SECRETKEYBYTES]);
+void sk_view_clear(sk_view *v);
+const uint8_t *sk_view_rho(const sk_view *v);
+const uint8_t *sk_view_key(const sk_view *v);
+const uint8_t *sk_view_tr(const sk_view *v);
+const poly *sk_view_s1_hat(sk_view *v, int i);
+const poly *sk_view_s2_hat(sk_view *v, int i);
+const poly *sk_view_t0_hat(sk_view *v, int i);
+int sign_view_mu(uint8_t sig[SIGBYTES], const uint8_t mu[CRHBYTES],
+                 sk_view *v, const uint8_t rnd[RNDBYTES]);
+int sign_view(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+              sk_view *v, const uint8_t rnd[RNDBYTES]);
+
+void seed_sk_init(seed_sk *ssk, const uint8_t xi[SEEDBYTES]);
+int seed_sk_cache_init(seed_sk_cache *c, int policy, size_t capacity, int cache_a);
+void seed_sk_cache_free(seed_sk_cache *c);
+void seed_sk_evict(seed_sk_cache *c, seed_sk *ssk);
+int sign_seed_sk(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+                 seed_sk *ssk, seed_sk_cache *c, const uint8_t rnd[RNDBYTES]);
+
+void sign_set_lazy_checks(int on);   // 1 (default): early-abort check order
+
+// Rejection-loop counters, off by default; cheap enough to leave compiled in
+void sign_stats_enable(int on);
+void sign_stats_reset(void);
+void sign_stats_get(sign_stats *out);
+
+// Pairwise consistency test (sign + verify) reusing keygen's A; the switch
+// installs it as the keygen hook (off by default)
+int dilithium_pct(const poly A[K][L], const public_key *pk, const secret_key *sk);
+void sign_set_keygen_pct(int on);
+
+// Scatter-gather variants: the message is the concatenation of iov[]
+int dilithium_sign_iov(uint8_t sig[SIGBYTES], const struct iovec *iov,
+                       int iovcnt, const secret_key *sk,
+                       const uint8_t rnd[RNDBYTES]);
+int sign_expanded_iov(uint8_t sig[SIGBYTES], const struct iovec *iov,
+                      int iovcnt, const expanded_sk *esk,
+                      const uint8_t rnd[RNDBYTES]);
+int dilithium_verify_iov(const uint8_t *sig, size_t siglen,
+                         const struct iovec *iov, int iovcnt,
+                         const public_key *pk);
+int verify_prepared_iov(const uint8_t *sig, size_t siglen,
+                        const struct iovec *iov, int iovcnt,
+                        const prepared_pk *ppk);
+
+int sign_prepared(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+                  const prepared_sk *psk, const uint8_t rnd[RNDBYTES]);
+int sign_speculative(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+                     const prepared_sk *psk, const uint8_t rnd[RNDBYTES],
+                     int width);
+
+// Pooled signing is always randomized; psk must outlive the pool
+commit_pool *commit_pool_new(const prepared_sk *psk, size_t capacity);
+void commit_pool_free(commit_pool *pool);
+void commit_pool_fill(commit_pool *pool);
+size_t commit_pool_level(commit_pool *pool);
+void commit_pool_stats(commit_pool *pool, size_t *hits, size_t *misses);
+int sign_pooled(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+                commit_pool *pool);
+
+int dilithium_sign(uint8_t sig[SIGBYTES], const uint8_t *m, size_t mlen,
+                   const secret_key *sk, const uint8_t rnd[RNDBYTES]);
+int dilithium_verify(const uint8_t sig[SIGBYTES], const uint8_t *m,
+                     size_t mlen, const public_key *pk);
+int dilithium_verify_len(const uint8_t *sig, size_t siglen, const uint8_t *m,
+                         size_t mlen, const public_key *pk);
+
+void prepare_pk(prepared_pk *ppk, const public_key *pk);
+const prepared_pk *prepared_pk_check(const void *buf, size_t len);
+int prepared_pk_write(const char *path, const public_key *pk);
+const prepared_pk *prepared_pk_map(const char *path);
+void prepared_pk_unmap(const prepared_pk *ppk);
+int verify_prepared_mu(const uint8_t *sig, size_t siglen,
+                       const uint8_t mu[CRHBYTES], const prepared_pk *ppk);
+int verify_prepared(const uint8_t *sig, size_t siglen, const uint8_t *m,
+                    size_t mlen, const prepared_pk *ppk);
+
+// Init, update per chunk, final; the key must outlive the context
+void sign_init(sign_ctx *ctx, const expanded_sk *esk);
+void sign_update(sign_ctx *ctx, const uint8_t *chunk, size_t len);
+int sign_final(sign_ctx *ctx, uint8_t sig[SIGBYTES],
+               const uint8_t rnd[RNDBYTES]);
+void verify_init(verify_ctx *ctx, const prepared_pk *ppk);
+void verify_update(verify_ctx *ctx, const uint8_t *chunk, size_t len);
+int verify_final(verify_ctx *ctx, const uint8_t *sig, size_t siglen);
+
+// Per-item 0 / -1 in results; returns 0 only if every item verified
+int verify_batch(const verify_item *items, int results[], size_t count);
+
+// Optional result cache: a repeated valid triple costs a lookup plus one
+// hash through a prepared_pk, or two through a public_key (tr is rederived
+// from pk, so an entry is always bound to the key that verified it).
+// Lock-free; one cache may be shared by every verifying thread, and
+// concurrent misses are safe under latency mode since fork_join runs one
+// caller's job at a time.
+verify_cache *verify_cache_new(size_t entries);
+void verify_cache_free(verify_cache *vc);
+void verify_cache_stats(const verify_cache *vc, uint64_t *hits,
+                        uint64_t *misses, uint64_t *inserts);
+int verify_cached(const uint8_t *sig, size_t siglen, const uint8_t *m,
+                  size_t mlen, const public_key *pk, verify_cache *vc);
+int verify_prepared_cached(const uint8_t *sig, size_t siglen, const uint8_t *m,
+                           size_t mlen, const prepared_pk *ppk, verify_cache *vc);
+
+int sign_batch(const secret_key *sk, const uint8_t *const msgs[],
+               const size_t mlens[], uint8_t (*sigs)[SIGBYTES],
+               size_t count, const uint8_t (*rnds)[RNDBYTES]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
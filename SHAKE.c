@@ -6,26 +6,14 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include "SHAKE.h"
 
-// ============================================================================
-// KECCAK PARAMETERS
-// ============================================================================
-#define KECCAK_ROUNDS 24
-#define STATE_SIZE 25      // 5x5 array of 64-bit lanes
-
-// SHAKE-128: rate = 168 bytes (1344 bits), capacity = 256 bits
-// SHAKE-256: rate = 136 bytes (1088 bits), capacity = 512 bits
-#define SHAKE128_RATE 168
-#define SHAKE256_RATE 136
-
-// ============================================================================
-// KECCAK STATE
-// ============================================================================
-typedef struct {
-    uint64_t state[STATE_SIZE];  // 5x5x64 = 1600 bits
-    size_t rate;                  // Rate in bytes
-    size_t absorb_pos;           // Current position in absorbing
-} keccak_state;
+// Narrate every sponge step in the standalone demo; stay quiet when embedded
+#ifdef SHAKE_NO_MAIN
+#define SHAKE_TRACE(...) ((void)0)
+#else
+#define SHAKE_TRACE(...) printf(__VA_ARGS__)
+#endif
 
 // ============================================================================
 // ROTATION OFFSETS (for ρ step)
@@ -62,7 +50,7 @@ static const uint64_t keccak_round_constants[KECCAK_ROUNDS] = {
 
 /* Rotate left */
 static inline uint64_t rotl64(uint64_t x, int n) {
-    return (x << n) | (x >> (64 - n));
+    return (x << n) | (x >> ((64 - n) & 63));
 }
 
 /* Convert 5x5 index to linear index */
@@ -167,7 +155,7 @@ void shake_init(keccak_state *ctx, int shake_bits) {
 void shake_absorb(keccak_state *ctx, const uint8_t *input, size_t inlen) {
     uint8_t *state_bytes = (uint8_t *)ctx->state;
     
-    printf("\nAbsorbing %zu bytes...\n", inlen);
+    SHAKE_TRACE("\nAbsorbing %zu bytes...\n", inlen);
     
     for (size_t i = 0; i < inlen; i++) {
         // XOR input byte into state at rate region
@@ -176,7 +164,7 @@ void shake_absorb(keccak_state *ctx, const uint8_t *input, size_t inlen) {
         
         // When rate is full, permute and reset position
         if (ctx->absorb_pos == ctx->rate) {
-            printf("  Rate full, applying permutation...\n");
+            SHAKE_TRACE("  Rate full, applying permutation...\n");
             keccak_f1600(ctx->state);
             ctx->absorb_pos = 0;
         }
@@ -187,7 +175,7 @@ void shake_absorb(keccak_state *ctx, const uint8_t *input, size_t inlen) {
 void shake_finalize(keccak_state *ctx) {
     uint8_t *state_bytes = (uint8_t *)ctx->state;
     
-    printf("\nFinalizing absorption...\n");
+    SHAKE_TRACE("\nFinalizing absorption...\n");
     
     // SHAKE domain separation: append 0x1F
     state_bytes[ctx->absorb_pos] ^= 0x1F;
@@ -204,12 +192,12 @@ void shake_finalize(keccak_state *ctx) {
 void shake_squeeze(keccak_state *ctx, uint8_t *output, size_t outlen) {
     uint8_t *state_bytes = (uint8_t *)ctx->state;
     
-    printf("\nSqueezing %zu bytes...\n", outlen);
+    SHAKE_TRACE("\nSqueezing %zu bytes...\n", outlen);
     
     for (size_t i = 0; i < outlen; i++) {
         // If we've used all rate bytes, permute to get more
         if (ctx->absorb_pos == ctx->rate) {
-            printf("  Rate exhausted, applying permutation...\n");
+            SHAKE_TRACE("  Rate exhausted, applying permutation...\n");
             keccak_f1600(ctx->state);
             ctx->absorb_pos = 0;
         }
@@ -228,9 +216,9 @@ void shake128(uint8_t *output, size_t outlen,
               const uint8_t *input, size_t inlen) {
     keccak_state ctx;
     
-    printf("\n=== SHAKE-128 ===");
-    printf("\nInput length: %zu bytes", inlen);
-    printf("\nOutput length: %zu bytes\n", outlen);
+    SHAKE_TRACE("\n=== SHAKE-128 ===");
+    SHAKE_TRACE("\nInput length: %zu bytes", inlen);
+    SHAKE_TRACE("\nOutput length: %zu bytes\n", outlen);
     
     shake_init(&ctx, 128);
     shake_absorb(&ctx, input, inlen);
@@ -242,9 +230,9 @@ void shake256(uint8_t *output, size_t outlen,
               const uint8_t *input, size_t inlen) {
     keccak_state ctx;
     
-    printf("\n=== SHAKE-256 ===");
-    printf("\nInput length: %zu bytes", inlen);
-    printf("\nOutput length: %zu bytes\n", inlen);
+    SHAKE_TRACE("\n=== SHAKE-256 ===");
+    SHAKE_TRACE("\nInput length: %zu bytes", inlen);
+    SHAKE_TRACE("\nOutput length: %zu bytes\n", inlen);
     
     shake_init(&ctx, 256);
     shake_absorb(&ctx, input, inlen);
@@ -252,9 +240,145 @@ void shake256(uint8_t *output, size_t outlen,
     shake_squeeze(&ctx, output, outlen);
 }
 
+// ============================================================================
+// FOUR-WAY KECCAK
+// ============================================================================
+/*
+ * Same permutation as keccak_f1600, applied to four states at once. Every
+ * step is a plain loop over the SHAKE_LANES words of one lane position,
+ * which vectorizes to 256-bit operations where the target has them.
+ */
+
+void keccak_f1600_x4(uint64_t state[STATE_SIZE][SHAKE_LANES]) {
+    uint64_t C[5][SHAKE_LANES], D[5][SHAKE_LANES], B[25][SHAKE_LANES];
+    
+    for (int round = 0; round < KECCAK_ROUNDS; round++) {
+        // θ
+        for (int x = 0; x < 5; x++) {
+            for (int j = 0; j < SHAKE_LANES; j++) {
+                C[x][j] = state[idx(x, 0)][j] ^ state[idx(x, 1)][j] ^
+                          state[idx(x, 2)][j] ^ state[idx(x, 3)][j] ^
+                          state[idx(x, 4)][j];
+            }
+        }
+        for (int x = 0; x < 5; x++) {
+            for (int j = 0; j < SHAKE_LANES; j++) {
+                D[x][j] = C[(x + 4) % 5][j] ^ rotl64(C[(x + 1) % 5][j], 1);
+            }
+        }
+        for (int x = 0; x < 5; x++) {
+            for (int y = 0; y < 5; y++) {
+                for (int j = 0; j < SHAKE_LANES; j++) {
+                    state[idx(x, y)][j] ^= D[x][j];
+                }
+            }
+        }
+        
+        // ρ and π
+        for (int x = 0; x < 5; x++) {
+            for (int y = 0; y < 5; y++) {
+                int r = keccak_rotations[idx(x, y)];
+                int to = idx(y, (2 * x + 3 * y) % 5);
+                for (int j = 0; j < SHAKE_LANES; j++) {
+                    B[to][j] = rotl64(state[idx(x, y)][j], r);
+                }
+            }
+        }
+        
+        // χ
+        for (int y = 0; y < 5; y++) {
+            for (int x = 0; x < 5; x++) {
+                for (int j = 0; j < SHAKE_LANES; j++) {
+                    state[idx(x, y)][j] = B[idx(x, y)][j] ^
+                        ((~B[idx((x + 1) % 5, y)][j]) & B[idx((x + 2) % 5, y)][j]);
+                }
+            }
+        }
+        
+        // ι
+        for (int j = 0; j < SHAKE_LANES; j++) {
+            state[0][j] ^= keccak_round_constants[round];
+        }
+    }
+}
+
+void shakex4_init(keccakx4_state *ctx, int shake_bits) {
+    memset(ctx, 0, sizeof(keccakx4_state));
+    ctx->rate = (shake_bits == 256) ? SHAKE256_RATE : SHAKE128_RATE;
+    ctx->pos = 0;
+}
+
+/* Absorb inlen bytes into every lane (byte b sits in word b/8, LSB first) */
+void shakex4_absorb(keccakx4_state *ctx,
+                    const uint8_t *const input[SHAKE_LANES], size_t inlen) {
+    for (size_t i = 0; i < inlen; i++) {
+        size_t w = ctx->pos / 8;
+        unsigned shift = 8 * (ctx->pos % 8);
+        for (int j = 0; j < SHAKE_LANES; j++) {
+            ctx->state[w][j] ^= (uint64_t)input[j][i] << shift;
+        }
+        if (++ctx->pos == ctx->rate) {
+            keccak_f1600_x4(ctx->state);
+            ctx->pos = 0;
+        }
+    }
+}
+
+void shakex4_finalize(keccakx4_state *ctx) {
+    for (int j = 0; j < SHAKE_LANES; j++) {
+        ctx->state[ctx->pos / 8][j] ^= (uint64_t)0x1F << (8 * (ctx->pos % 8));
+        ctx->state[(ctx->rate - 1) / 8][j] ^= (uint64_t)0x80 << 56;
+    }
+    keccak_f1600_x4(ctx->state);
+    ctx->pos = 0;
+}
+
+/* Whole aligned words go out 8 bytes at a time; the ragged edges byte-wise */
+void shakex4_squeeze(keccakx4_state *ctx,
+                     uint8_t *const output[SHAKE_LANES], size_t outlen) {
+    size_t i = 0;
+
+    while (i < outlen) {
+        if (ctx->pos == ctx->rate) {
+            keccak_f1600_x4(ctx->state);
+            ctx->pos = 0;
+        }
+        size_t w = ctx->pos / 8;
+        if (ctx->pos % 8 == 0 && outlen - i >= 8 && ctx->rate - ctx->pos >= 8) {
+            for (int j = 0; j < SHAKE_LANES; j++) {
+                uint64_t v = ctx->state[w][j];
+                for (int b = 0; b < 8; b++) {
+                    output[j][i + b] = (uint8_t)(v >> (8 * b));
+                }
+            }
+            i += 8;
+            ctx->pos += 8;
+        } else {
+            unsigned shift = 8 * (ctx->pos % 8);
+            for (int j = 0; j < SHAKE_LANES; j++) {
+                output[j][i] = (uint8_t)(ctx->state[w][j] >> shift);
+            }
+            i++;
+            ctx->pos++;
+        }
+    }
+}
+
+/* Four independent SHAKE-256 calls with equal input and output lengths */
+void shake256x4(uint8_t *const output[SHAKE_LANES], size_t outlen,
+                const uint8_t *const input[SHAKE_LANES], size_t inlen) {
+    keccakx4_state ctx;
+    
+    shakex4_init(&ctx, 256);
+    shakex4_absorb(&ctx, input, inlen);
+    shakex4_finalize(&ctx);
+    shakex4_squeeze(&ctx, output, outlen);
+}
+
 // ============================================================================
 // DEMO AND TESTING
 // ============================================================================
+#ifndef SHAKE_NO_MAIN
 
 void print_hex(const char *label, const uint8_t *data, size_t len) {
     printf("%s: ", label);
@@ -336,4 +460,6 @@ int main() {
            consistent ? "✓ YES (Extendable property works!)" : "✗ NO");
     
     return 0;
-}
\ No newline at end of file
+}
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * SHAKE-128/256 Implementation
+ * Sponge state and entry points of SHAKE.c, for code that embeds it
+ * (compile SHAKE.c with -DSHAKE_NO_MAIN to drop the demo and its tracing)
+ */
+
+#ifndef SHAKE_H
+#define SHAKE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ============================================================================
+// KECCAK PARAMETERS
+// ============================================================================
+#define KECCAK_ROUNDS 24
+#define STATE_SIZE 25      // 5x5 array of 64-bit lanes
+
+// SHAKE-128: rate = 168 bytes (1344 bits), capacity = 256 bits
+// SHAKE-256: rate = 136 bytes (1088 bits), capacity = 512 bits
+#define SHAKE128_RATE 168
+#define SHAKE256_RATE 136
+
+#define SHAKE_LANES 4      // Independent sponges in a keccakx4_state
+
+// ============================================================================
+// KECCAK STATE
+// ============================================================================
+typedef struct {
+    uint64_t state[STATE_SIZE];  // 5x5x64 = 1600 bits
+    size_t rate;                  // Rate in bytes
+    size_t absorb_pos;           // Current position in absorbing
+} keccak_state;
+
+/*
+ * Four sponges advanced in lockstep. Word w of lane j lives at
+ * state[w][j], so every step of the permutation is a loop over four
+ * adjacent words that the compiler can keep in one SIMD register.
+ * All lanes absorb and squeeze the same number of bytes.
+ */
+typedef struct {
+    uint64_t state[STATE_SIZE][SHAKE_LANES];
+    size_t rate;
+    size_t pos;
+} keccakx4_state;
+
+// ============================================================================
+// API
+// ============================================================================
+void keccak_f1600(uint64_t state[STATE_SIZE]);
+void shake_init(keccak_state *ctx, int shake_bits);
+void shake_absorb(keccak_state *ctx, const uint8_t *input, size_t inlen);
+void shake_finalize(keccak_state *ctx);
+void shake_squeeze(keccak_state *ctx, uint8_t *output, size_t outlen);
+
+void shake128(uint8_t *output, size_t outlen,
+              const uint8_t *input, size_t inlen);
+void shake256(uint8_t *output, size_t outlen,
+              const uint8_t *input, size_t inlen);
+
+void keccak_f1600_x4(uint64_t state[STATE_SIZE][SHAKE_LANES]);
+void shakex4_init(keccakx4_state *ctx, int shake_bits);
+void shakex4_absorb(keccakx4_state *ctx,
+                    const uint8_t *const input[SHAKE_LANES], size_t inlen);
+void shakex4_finalize(keccakx4_state *ctx);
+void shakex4_squeeze(keccakx4_state *ctx,
+                     uint8_t *const output[SHAKE_LANES], size_t outlen);
+void shake256x4(uint8_t *const output[SHAKE_LANES], size_t outlen,
+                const uint8_t *const input[SHAKE_LANES], size_t inlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif